@@ -1,13 +1,36 @@
 ﻿// based from: https://lazyfoo.net/tutorials/SDL/51_SDL_and_modern_opengl/index.php
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <span>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#if defined(_M_X64) || defined(__x86_64__)
+#define GRIPPR_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 #include <SDL.h>
 #include <SDL_opengl.h>
 #include <gl/glu.h>
@@ -15,6 +38,15 @@
 #include <glm/vec3.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// offscreen rendering needs EGL, which the windows build doesn't have
+#if !defined(GRIPPR_NO_EGL) && __has_include(<EGL/egl.h>)
+#define GRIPPR_EGL 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "robotable.h"
+
 
 using namespace std;
 using mat4 = glm::mat4;
@@ -52,6 +84,85 @@ GLUquadric* gQuadric = nullptr;
 double gWallTime = 0;
 
 
+enum class SimdLevel
+{
+    Scalar,
+    Avx2,
+    Avx512,
+    Auto,
+};
+
+enum class SolveOrder
+{
+    RowMajor,
+    Wavefront,
+};
+
+enum class TableEncoding
+{
+    Raw,
+    RowDelta,
+    BitPack,
+};
+
+enum class SolverType
+{
+    Gradient,
+    Analytic,
+    DampedLeastSquares,
+};
+
+enum class StartObjective
+{
+    Error,      // hand position error of the whole-degree pose
+    Rest,       // joint distance from the rest pose
+    Smooth,     // joint distance from the neighbouring cells' solutions
+};
+
+struct Options
+{
+    bool headless = false;
+    bool bench = false;
+    bool verbose = true;
+    int numThreads = 0;     // 0 means one per hardware thread
+    SolverType solver = SolverType::Gradient;
+    SimdLevel simd = SimdLevel::Auto;
+    int refineWindow = 2;   // whole-angle refinement tries +-this many degrees around each solved angle
+    SolveOrder order = SolveOrder::Wavefront;
+    bool mirror = false;        // solve x >= 0 only and mirror the rest
+    bool halfTable = false;     // only emit x >= 0, with an accessor that mirrors at lookup time
+    TableEncoding encoding = TableEncoding::Raw;
+    int maxIterations = 2000;   // a target that isn't solved in this many IK steps is given up on
+    bool workspaceMap = true;   // reject targets the arm can't reach before trying to solve them
+    int numStarts = 1;          // if more than 1, solve each target again from this many seeds in all and keep the best
+    StartObjective startObjective = StartObjective::Error;
+    bool solverThread = true;   // solve on a thread of its own while the window draws, rather than in between frames
+    bool legacyRender = false;  // draw with the immediate-mode code even if the retained renderer would work
+    int renderBenchTargets = 0; // if set, time frames with this many targets instead of solving
+    bool offscreen = false;     // replay the windowed solve without a window, writing the frames out
+    string offscreenDir = "frames";
+    int offscreenStepsPerFrame = 25;
+    int offscreenCaptureEvery = 1;  // 0 only writes the final frame
+    string goldenPath;          // if set, check the final offscreen frame against this PPM
+    int goldenLevels = 16;      // how far a channel can be off before a pixel counts as different
+    float goldenPercent = 0.5f; // and how many pixels can be different before the check fails
+    int maxFps = 60;            // 0 draws as fast as it can while there's something to draw
+    bool vsync = false;
+    float frameBudgetMs = 12.f; // how long the window spends solving each frame without a solver thread
+    int interpErrorStep = 0;    // if set, sample lookupMm() every this many mm and report the hand position error
+    bool exhaustive = false;    // compare the solved table with the best whole-degree poses, found by trying them all
+    bool exhaustiveTable = false;   // ...and write those instead
+    string cacheDir;            // if set, keep solved targets in a cache here and reuse them
+    bool binaryTable = false;   // also write roboboogie.bin for host tools, see robotable.h
+    bool volume = false;        // also solve the grid at several heights and stream it to robovolume.h
+    bool volumeBinary = false;  // ...or to robovolume.bin in the robotable.h format
+    float volumeMinY = 5.f;
+    float volumeMaxY = 65.f;
+    float volumeStepY = 20.f;
+};
+Options gOptions;
+
+
 class PushMatrixScope
 {
 public:
@@ -76,37 +187,438 @@ enum Bones
     NumBones,
 };
 using BoneArray = array<float, NumBones>;
-BoneArray gRotations = { 0.f, -22.f, -65.f, -80.f };
+using WholeBoneArray = array<int, NumBones>;
+static const BoneArray REST_ROTATIONS = { 0.f, -22.f, -65.f, -80.f };
+// the servos only turn through 180 degrees, centred on the arm pointing straight on
+static const int SERVO_MIN_DEGREES = -90;
+static const int SERVO_MAX_DEGREES = 90;
+
+// whether whole-degree refinement can try candidate for a joint the solver left at rot: it mustn't take a pitch joint
+// that's inside the servo range outside it. the base has no limit here, it just faces the target
+inline bool isRefinementCandidate(int bone, float rot, int candidate)
+{
+    bool rotInServoRange = rot >= SERVO_MIN_DEGREES && rot <= SERVO_MAX_DEGREES;
+    bool candidateInServoRange = candidate >= SERVO_MIN_DEGREES && candidate <= SERVO_MAX_DEGREES;
+    return bone == BASE_ROT || candidateInServoRange || !rotInServoRange;
+}
+BoneArray gRotations = REST_ROTATIONS;
 BoneArray gTranslations = { SHOULDER_HEIGHT, ARM_LENGTH, ARM_LENGTH, HAND_LENGTH + PEN_LENGTH };
 
 
 
-vec3 calcHandPoint(span<const float> rotations);
+vec3 calcHandPoint(const BoneArray& rotations);
 
+// counts forward kinematics evaluations on this thread, so the solvers can be compared on work done rather than time
+thread_local int64_t tFkEvaluations = 0;
 
 
+
+enum class TargetStatus
+{
+    Solving,
+    Found,
+    Unreachable,    // outside the workspace map, so never tried
+    GaveUp,         // ran out of iterations
+};
+
 struct TargetPoint
 {
     vec3 pos;
     vec3 initialPos;
-    bool found;
+    TargetStatus status = TargetStatus::Solving;
     BoneArray rots;
+    BoneArray ikRots;       // the continuous IK solution, before refinement to whole angles
+    int iterations = 0;
+    int fkEvaluations = 0;  // spent finding the IK solution, not counting refinement
+    int refineEvaluations = 0;
+    int refinePruned = 0;
 };
 
 
 vector<TargetPoint> gTargets;
 static const float TARGET_MIN_X = -120.f;
 static const float TARGET_MAX_X =  120.f;
-static const float TARGET_STEP_X = 10.f;
+static constexpr float TARGET_STEP_X = 10.f;
 static const float TARGET_Y = 5.f;
 static const float TARGET_MIN_Z = 160.f;
 static const float TARGET_MAX_Z = 300.f;
-static const float TARGET_STEP_Z = 10.f;
-float gNextTargetX = TARGET_MIN_X;
-float gNextTargetZ = TARGET_MIN_Z;
+static constexpr float TARGET_STEP_Z = 10.f;
+// the tables have a grid point every cm, and lookupMm() blends them in whole mm with weights in hundredths of a cell
+static const int TABLE_CELL_X_MM = (int)TARGET_STEP_X;
+static const int TABLE_CELL_Z_MM = (int)TARGET_STEP_Z;
+static_assert(TARGET_STEP_X == 10.f && TARGET_STEP_Z == 10.f, "the tables are addressed in cm, one grid point each");
+static_assert(TABLE_CELL_X_MM * TABLE_CELL_Z_MM * 128 <= 32768, "lookupMm() has to blend a cell in 16 bit ints");
+size_t gCurrentTarget = 0;     // the one the windowed solve is working on
+int64_t gNumSolverSteps = 0;
 bool gFoundAllTargets = false;
-bool gWrittenResults = false;
+bool gWrittenResults = false;  // we've had our one go at writing them, whether or not it worked
+bool gWriteFailed = false;
+
+mutex gLogMutex;
+
+
+// a single producer, single consumer triple buffer. the writer always has a slot of its own to fill and the reader one
+// of its own to read, and they swap them through the third, so neither ever waits for the other. the reader gets the
+// latest value that was published, skipping any it was too slow to see
+template<typename T>
+class TripleBuffer
+{
+public:
+    T& writeSlot()
+    {
+        return mSlots[mWriteIndex];
+    }
+
+    // hands the write slot over to the reader, and takes back whichever slot it isn't using
+    void publish()
+    {
+        mWriteIndex = mMiddle.exchange(mWriteIndex | FRESH, memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // whether there's been a publish since the last read(), so the reader can tell without taking it
+    bool hasFresh() const
+    {
+        return (mMiddle.load(memory_order_relaxed) & FRESH) != 0;
+    }
+
+    const T& read()
+    {
+        if (mMiddle.load(memory_order_relaxed) & FRESH)
+            mReadIndex = mMiddle.exchange(mReadIndex, memory_order_acq_rel) & INDEX_MASK;
+        return mSlots[mReadIndex];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;     // set on the middle slot when it's newer than what the reader has
+
+    T mSlots[3] = {};
+    int mWriteIndex = 0;
+    int mReadIndex = 1;
+    atomic<int> mMiddle = 2;
+};
+
+// what render() needs of the windowed solve. the solver owns gRotations and the targets it's working on, and publishes
+// one of these after every step, so the two can run on different threads without ever blocking each other
+struct ViewSnapshot
+{
+    BoneArray rots = REST_ROTATIONS;
+    TargetStatus status = TargetStatus::Solving;    // of the target being worked on, or the last one
+    int numDone = 0;        // gTargets before this are done with and won't change again
+    int64_t numSteps = 0;
+};
+TripleBuffer<ViewSnapshot> gViewSnapshots;
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// retained-mode rendering. the box and sphere meshes go into vertex buffers once, and all the target markers are drawn
+// with one instanced call, their positions uploaded as they're solved. it all still goes through the fixed-function
+// matrix stack and lighting, so the arm's PushMatrixScope hierarchy works as it always has. the entry points are fetched
+// through gGetGlProcAddress, and if the context can't do instancing we stay on the immediate-mode code
+
+static const int SPHERE_SLICES = 16;
+static const int SPHERE_STACKS = 16;
+// the target markers are only a few pixels across, so they get by with far fewer triangles
+static const int MARKER_SLICES = 8;
+static const int MARKER_STACKS = 6;
+
+// where GL entry points come from: SDL's context for the window, EGL's offscreen
+void* (*gGetGlProcAddress)(const char*) = SDL_GL_GetProcAddress;
+
+class RetainedRenderer
+{
+public:
+    // returns false, saying why, if this context can't run it
+    bool init()
+    {
+        int major = 0;
+        int minor = 0;
+        const char* version = (const char*)glGetString(GL_VERSION);
+        if (!version || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 21)
+        {
+            cerr << "retained renderer needs GL 2.1, this is " << (version ? version : "unknown") << endl;
+            return false;
+        }
+
+        bool ok = load(mGenBuffers, "glGenBuffers") && load(mBindBuffer, "glBindBuffer") && load(mBufferData, "glBufferData")
+            && load(mBufferSubData, "glBufferSubData") && load(mCreateShader, "glCreateShader")
+            && load(mShaderSource, "glShaderSource") && load(mCompileShader, "glCompileShader")
+            && load(mGetShaderiv, "glGetShaderiv") && load(mGetShaderInfoLog, "glGetShaderInfoLog")
+            && load(mCreateProgram, "glCreateProgram") && load(mAttachShader, "glAttachShader")
+            && load(mLinkProgram, "glLinkProgram") && load(mGetProgramiv, "glGetProgramiv")
+            && load(mUseProgram, "glUseProgram") && load(mGetAttribLocation, "glGetAttribLocation")
+            && load(mGetUniformLocation, "glGetUniformLocation") && load(mUniform1f, "glUniform1f")
+            && load(mEnableVertexAttribArray, "glEnableVertexAttribArray")
+            && load(mDisableVertexAttribArray, "glDisableVertexAttribArray")
+            && load(mVertexAttribPointer, "glVertexAttribPointer");
+
+        // mesa hands out a pointer for any name at all, so go by the version and extensions for the instancing ones
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        if (major * 10 + minor >= 33)
+            ok = ok && load(mDrawArraysInstanced, "glDrawArraysInstanced") && load(mVertexAttribDivisor, "glVertexAttribDivisor");
+        else if (extensions && strstr(extensions, "GL_ARB_draw_instanced") && strstr(extensions, "GL_ARB_instanced_arrays"))
+            ok = ok && load(mDrawArraysInstanced, "glDrawArraysInstancedARB") && load(mVertexAttribDivisor, "glVertexAttribDivisorARB");
+        else
+            ok = false;
+        if (!ok)
+        {
+            cerr << "retained renderer needs instanced arrays, which GL " << version << " doesn't have" << endl;
+            return false;
+        }
 
+        if (!buildProgram())
+            return false;
+
+        mBox = uploadMesh(makeBoxVertices());
+        mSphere = uploadMesh(makeSphereVertices(SPHERE_SLICES, SPHERE_STACKS));
+        mMarker = uploadMesh(makeSphereVertices(MARKER_SLICES, MARKER_STACKS));
+        mGenBuffers(1, &mInstanceBuffer);
+
+        // the meshes are unit sized and scaled into place, which would scale the normals too
+        glEnable(GL_NORMALIZE);
+        return true;
+    }
+
+    // a box sitting on the origin, like renderBox()
+    void drawBox(float width, float height, float depth)
+    {
+        PushMatrixScope scale;
+        glScalef(width, height, depth);
+        drawMesh(mBox);
+    }
+
+    void drawSphere(float radius)
+    {
+        PushMatrixScope scale;
+        glScalef(radius, radius, radius);
+        drawMesh(mSphere);
+    }
+
+    // a sphere at every target that's done, and one where the current one wants to be. the targets that are done
+    // never change again, so only the ones finished since last time are uploaded
+    void drawTargets(const vector<TargetPoint>& targets, int numDone, float radius)
+    {
+        int count = min(numDone + 1, (int)targets.size());
+        if (count == 0)
+            return;
+
+        mBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+        if (targets.size() != mInstanceCapacity || numDone < mNumUploaded)
+        {
+            mInstanceCapacity = targets.size();
+            mBufferData(GL_ARRAY_BUFFER, mInstanceCapacity * sizeof(vec3), nullptr, GL_DYNAMIC_DRAW);
+            mNumUploaded = 0;
+        }
+        if (count > mNumUploaded)
+        {
+            mUploadScratch.clear();
+            for (int i = mNumUploaded; i < count; ++i)
+                mUploadScratch.push_back(i < numDone ? targets[i].pos : targets[i].initialPos);
+            mBufferSubData(GL_ARRAY_BUFFER, mNumUploaded * sizeof(vec3), mUploadScratch.size() * sizeof(vec3), mUploadScratch.data());
+            // the current target's entry gets its solved position next time
+            mNumUploaded = numDone;
+        }
+        mVertexAttribPointer(mOffsetAttrib, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        mEnableVertexAttribArray(mOffsetAttrib);
+        mVertexAttribDivisor(mOffsetAttrib, 1);
+
+        mUseProgram(mProgram);
+        mUniform1f(mRadiusUniform, radius);
+        bindMesh(mMarker);
+        mDrawArraysInstanced(GL_TRIANGLES, 0, mMarker.numVertices, count);
+        unbindMesh();
+        mUseProgram(0);
+
+        mVertexAttribDivisor(mOffsetAttrib, 0);
+        mDisableVertexAttribArray(mOffsetAttrib);
+    }
+
+private:
+    struct Mesh
+    {
+        GLuint buffer = 0;
+        GLsizei numVertices = 0;
+    };
+
+    // vertices are interleaved position and normal
+    static const GLsizei VERTEX_STRIDE = 6 * sizeof(float);
+
+    template<typename Fn>
+    static bool load(Fn& fn, const char* name)
+    {
+        fn = (Fn)gGetGlProcAddress(name);
+        return fn != nullptr;
+    }
+
+    static void addVertex(vector<float>& vertices, vec3 pos, vec3 normal)
+    {
+        vertices.insert(vertices.end(), { pos.x, pos.y, pos.z, normal.x, normal.y, normal.z });
+    }
+
+    // the same faces as renderBox(), 1 unit each way, split into triangles
+    static vector<float> makeBoxVertices()
+    {
+        struct Face { vec3 normal; vec3 corners[4]; };
+        static const Face faces[] = {
+            { { 0.f, 1.f, 0.f }, { { -0.5f, 1.f, -0.5f }, { 0.5f, 1.f, -0.5f }, { 0.5f, 1.f, 0.5f }, { -0.5f, 1.f, 0.5f } } },
+            { { 0.f, 0.f, 1.f }, { { -0.5f, 1.f, 0.5f }, { 0.5f, 1.f, 0.5f }, { 0.5f, 0.f, 0.5f }, { -0.5f, 0.f, 0.5f } } },
+            { { 1.f, 0.f, 0.f }, { { 0.5f, 1.f, 0.5f }, { 0.5f, 0.f, 0.5f }, { 0.5f, 0.f, -0.5f }, { 0.5f, 1.f, -0.5f } } },
+            { { 0.f, 0.f, -1.f }, { { -0.5f, 1.f, -0.5f }, { -0.5f, 0.f, -0.5f }, { 0.5f, 0.f, -0.5f }, { 0.5f, 1.f, -0.5f } } },
+            { { -1.f, 0.f, 0.f }, { { -0.5f, 1.f, 0.5f }, { -0.5f, 1.f, -0.5f }, { -0.5f, 0.f, -0.5f }, { -0.5f, 0.f, 0.5f } } },
+            { { 0.f, -1.f, 0.f }, { { -0.5f, 0.f, -0.5f }, { -0.5f, 0.f, 0.5f }, { 0.5f, 0.f, 0.5f }, { 0.5f, 0.f, -0.5f } } },
+        };
+
+        vector<float> vertices;
+        for (const Face& face : faces)
+        {
+            for (int corner : { 0, 1, 2, 0, 2, 3 })
+                addVertex(vertices, face.corners[corner], face.normal);
+        }
+        return vertices;
+    }
+
+    // a unit sphere tessellated like gluSphere, slices round the z axis and stacks along it. both triangles of each
+    // quad end on the same corner, so GL_FLAT shades the quad in one colour as gluSphere's quad strips do
+    static vector<float> makeSphereVertices(int slices, int stacks)
+    {
+        auto point = [=](int slice, int stack)
+        {
+            float theta = TWOPI * slice / slices;
+            float phi = PI * stack / stacks;
+            return vec3(sinf(phi) * sinf(theta), sinf(phi) * cosf(theta), cosf(phi));
+        };
+
+        vector<float> vertices;
+        for (int stack = 0; stack < stacks; ++stack)
+        {
+            for (int slice = 0; slice < slices; ++slice)
+            {
+                vec3 p00 = point(slice, stack);
+                vec3 p10 = point(slice + 1, stack);
+                vec3 p01 = point(slice, stack + 1);
+                vec3 p11 = point(slice + 1, stack + 1);
+                for (vec3 p : { p00, p01, p11, p10, p00, p11 })
+                    addVertex(vertices, p, p);
+            }
+        }
+        return vertices;
+    }
+
+    Mesh uploadMesh(const vector<float>& vertices)
+    {
+        Mesh mesh;
+        mesh.numVertices = (GLsizei)(vertices.size() / 6);
+        mGenBuffers(1, &mesh.buffer);
+        mBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+        mBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        mBindBuffer(GL_ARRAY_BUFFER, 0);
+        return mesh;
+    }
+
+    void bindMesh(const Mesh& mesh)
+    {
+        mBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, VERTEX_STRIDE, (const void*)0);
+        glNormalPointer(GL_FLOAT, VERTEX_STRIDE, (const void*)(3 * sizeof(float)));
+    }
+
+    void unbindMesh()
+    {
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        mBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void drawMesh(const Mesh& mesh)
+    {
+        bindMesh(mesh);
+        glDrawArrays(GL_TRIANGLES, 0, mesh.numVertices);
+        unbindMesh();
+    }
+
+    // only a vertex shader, which offsets each instance and does the same lighting as the fixed-function pipeline
+    // (ambient plus one directional light, with glColor as the material). the fixed-function fragment stage takes it
+    // from there, so GL_FLAT still applies
+    bool buildProgram()
+    {
+        static const char* source =
+            "#version 120\n"
+            "attribute vec3 instanceOffset;\n"
+            "uniform float radius;\n"
+            "void main()\n"
+            "{\n"
+            "    gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz * radius + instanceOffset, 1.0);\n"
+            "    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);\n"
+            "    float diffuse = max(dot(normal, normalize(gl_LightSource[0].position.xyz)), 0.0);\n"
+            "    gl_FrontColor = vec4(gl_Color.rgb * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+            "        + gl_LightSource[0].diffuse.rgb * diffuse), gl_Color.a);\n"
+            "}\n";
+
+        GLuint shader = mCreateShader(GL_VERTEX_SHADER);
+        mShaderSource(shader, 1, &source, nullptr);
+        mCompileShader(shader);
+        GLint status = 0;
+        mGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (!status)
+        {
+            char log[1024] = {};
+            mGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            cerr << "couldn't compile the instancing shader: " << log << endl;
+            return false;
+        }
+
+        mProgram = mCreateProgram();
+        mAttachShader(mProgram, shader);
+        mLinkProgram(mProgram);
+        mGetProgramiv(mProgram, GL_LINK_STATUS, &status);
+        if (!status)
+        {
+            cerr << "couldn't link the instancing shader" << endl;
+            return false;
+        }
+
+        mOffsetAttrib = mGetAttribLocation(mProgram, "instanceOffset");
+        mRadiusUniform = mGetUniformLocation(mProgram, "radius");
+        return mOffsetAttrib >= 0;
+    }
+
+    PFNGLGENBUFFERSPROC mGenBuffers = nullptr;
+    PFNGLBINDBUFFERPROC mBindBuffer = nullptr;
+    PFNGLBUFFERDATAPROC mBufferData = nullptr;
+    PFNGLBUFFERSUBDATAPROC mBufferSubData = nullptr;
+    PFNGLCREATESHADERPROC mCreateShader = nullptr;
+    PFNGLSHADERSOURCEPROC mShaderSource = nullptr;
+    PFNGLCOMPILESHADERPROC mCompileShader = nullptr;
+    PFNGLGETSHADERIVPROC mGetShaderiv = nullptr;
+    PFNGLGETSHADERINFOLOGPROC mGetShaderInfoLog = nullptr;
+    PFNGLCREATEPROGRAMPROC mCreateProgram = nullptr;
+    PFNGLATTACHSHADERPROC mAttachShader = nullptr;
+    PFNGLLINKPROGRAMPROC mLinkProgram = nullptr;
+    PFNGLGETPROGRAMIVPROC mGetProgramiv = nullptr;
+    PFNGLUSEPROGRAMPROC mUseProgram = nullptr;
+    PFNGLGETATTRIBLOCATIONPROC mGetAttribLocation = nullptr;
+    PFNGLGETUNIFORMLOCATIONPROC mGetUniformLocation = nullptr;
+    PFNGLUNIFORM1FPROC mUniform1f = nullptr;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC mEnableVertexAttribArray = nullptr;
+    PFNGLDISABLEVERTEXATTRIBARRAYPROC mDisableVertexAttribArray = nullptr;
+    PFNGLVERTEXATTRIBPOINTERPROC mVertexAttribPointer = nullptr;
+    PFNGLDRAWARRAYSINSTANCEDPROC mDrawArraysInstanced = nullptr;
+    PFNGLVERTEXATTRIBDIVISORPROC mVertexAttribDivisor = nullptr;
+
+    Mesh mBox;
+    Mesh mSphere;
+    Mesh mMarker;
+    GLuint mProgram = 0;
+    GLint mOffsetAttrib = -1;
+    GLint mRadiusUniform = -1;
+    GLuint mInstanceBuffer = 0;
+    size_t mInstanceCapacity = 0;
+    int mNumUploaded = 0;
+    vector<vec3> mUploadScratch;
+};
+RetainedRenderer gRetainedRenderer;
+bool gUseRetainedRenderer = false;
 
 
 void renderFloor(float size)
@@ -124,6 +636,12 @@ void renderFloor(float size)
 
 void renderBox(float width, float height, float depth)
 {
+    if (gUseRetainedRenderer)
+    {
+        gRetainedRenderer.drawBox(width, height, depth);
+        return;
+    }
+
     width *= 0.5f;
     depth *= 0.5f;
 
@@ -167,9 +685,17 @@ void renderBox(float width, float height, float depth)
     glEnd();
 }
 
+void renderSphere(float radius)
+{
+    if (gUseRetainedRenderer)
+        gRetainedRenderer.drawSphere(radius);
+    else
+        gluSphere(gQuadric, radius, SPHERE_SLICES, SPHERE_STACKS);
+}
+
 void renderBase(float radius)
 {
-    gluSphere(gQuadric, radius, 16, 16);
+    renderSphere(radius);
 }
 
 void renderArm()
@@ -229,7 +755,34 @@ void renderAxis()
 }
 
 
-void render()
+// the targets that are done with won't change again, and nothing ever writes to initialPos, so reading them here is safe
+// whatever the solver's doing
+void renderTargets(int numDone)
+{
+    if (gUseRetainedRenderer)
+    {
+        gRetainedRenderer.drawTargets(gTargets, numDone, 5.f);
+        return;
+    }
+
+    for (int i = 0; i < numDone; ++i)
+    {
+        PushMatrixScope targetScope;
+        glTranslatef(gTargets[i].pos.x, gTargets[i].pos.y, gTargets[i].pos.z);
+        renderSphere(5.f);
+    }
+    if (numDone < (int)gTargets.size())
+    {
+        PushMatrixScope targetScope;
+        vec3 pos = gTargets[numDone].initialPos;
+        glTranslatef(pos.x, pos.y, pos.z);
+        renderSphere(5.f);
+    }
+}
+
+
+// draws the scene as of view, which the caller takes from gViewSnapshots once a frame
+void render(const ViewSnapshot& view)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -252,25 +805,25 @@ void render()
     {
         PushMatrixScope baseScope;
         glTranslatef(0.f, BASE_HEIGHT, 0.f);
-        glRotatef(gRotations[BASE_ROT], 0.f, -1.f, 0.f);
+        glRotatef(view.rots[BASE_ROT], 0.f, -1.f, 0.f);
 
         renderBase(SHOULDER_HEIGHT);
         {
             PushMatrixScope shoulderScope;
             glTranslatef(0.f, SHOULDER_HEIGHT, 0.f);
-            glRotatef(gRotations[SHOULDER], -1.f, 0.f, 0.f);
+            glRotatef(view.rots[SHOULDER], -1.f, 0.f, 0.f);
 
             renderArm();
             {
                 PushMatrixScope uArmScope;
                 glTranslatef(0.f, ARM_LENGTH, 0.f);
-                glRotatef(gRotations[ELBOW], -1.f, 0.f, 0.f);
+                glRotatef(view.rots[ELBOW], -1.f, 0.f, 0.f);
 
                 renderArm();
                 {
                     PushMatrixScope lArmScope;
                     glTranslatef(0.f, ARM_LENGTH, 0.f);
-                    glRotatef(gRotations[WRIST], -1.f, 0.f, 0.f);
+                    glRotatef(view.rots[WRIST], -1.f, 0.f, 0.f);
 
                     renderHand();
                 }
@@ -280,24 +833,19 @@ void render()
 
     {
         PushMatrixScope effectorScope;
-        vec3 effectorPos = calcHandPoint(gRotations);
+        vec3 effectorPos = calcHandPoint(view.rots);
         glTranslatef(effectorPos.x, effectorPos.y, effectorPos.z);
 
-        if (gTargets.empty() || !gTargets.back().found)
+        if (view.status != TargetStatus::Found)
             glColor3f(1.f, 0.6f, 0.6f);
         else
             glColor3f(0.6f, 1.0f, 0.6f);
 
-        gluSphere(gQuadric, 15.f, 16, 16);
+        renderSphere(15.f);
     }
 
-    for (auto& target : gTargets)
-    {
-        PushMatrixScope targetScope;
-        glTranslatef(target.pos.x, target.pos.y, target.pos.z);
-        glColor3f(0.6f, 0.6f, 1.f);
-        gluSphere(gQuadric, 5.f, 16, 16);
-    }
+    glColor3f(0.6f, 0.6f, 1.f);
+    renderTargets(view.numDone);
 
     glPopMatrix();
 }
@@ -305,8 +853,12 @@ void render()
 
 // ---------------------------------------------------------------------------------------------------------------------------
 
-vec3 calcHandPoint(span<const float> rotations)
+// the straightforward matrix chain, mirroring what render() does with the GL matrix stack. everything hot goes through
+// calcHandPoint() instead, but this stays as the reference it is checked against
+vec3 calcHandPointReference(span<const float> rotations)
 {
+    ++tFkEvaluations;
+
     mat4 transform(1.f);
 
     transform = glm::translate(transform, vec3(0.f, BASE_HEIGHT, 0.f));
@@ -324,298 +876,4337 @@ vec3 calcHandPoint(span<const float> rotations)
 }
 
 
-ostream& operator<<(ostream& os, const TargetPoint& target)
+// every joint is a fixed-axis rotation followed by a translation up the bone, and every joint after the base pitches
+// in the same vertical plane. so after the base yaw the chain is just a running sum of (sin, cos) of the accumulated
+// pitch, with no matrices needed
+template<size_t N>
+vec3 calcHandPointPlanar(const array<float, N>& rotations)
 {
-    for (span<const float> rots(target.rots); const float& rot : rots)
-    {
-        if (rot != rots.front())
-            os << ", ";
-        os << rot;
-    }
-    vec3 pos = calcHandPoint(target.rots);
-    float dist = glm::distance(target.initialPos, pos);
-    os << " (" << dist << " away)";
-    return os;
-}
-
+    static_assert(N >= 1, "need at least the base rotation");
 
+    ++tFkEvaluations;
 
-static const int numRefinementGuesses = 4;
-
-template<int BoneId>
-void refineBoneToWholeAngles(BoneArray& currRots, BoneArray& baseRots, const TargetPoint& target, BoneArray& bestRots, vec3& bestPos, float& bestDistSq)
-{
-    for (int guess = 0; guess < numRefinementGuesses; ++guess)
+    float reach = 0.f;
+    float height = BASE_HEIGHT + gTranslations[0];
+    float pitch = 0.f;
+    for (size_t i = 1; i < N; ++i)
     {
-        currRots[BoneId] = baseRots[BoneId] + (float)guess;
-
-        refineBoneToWholeAngles<BoneId + 1>(currRots, baseRots, target, bestRots, bestPos, bestDistSq);
+        pitch -= rotations[i] * DEGTORAD;
+        reach += gTranslations[i] * sinf(pitch);
+        height += gTranslations[i] * cosf(pitch);
     }
+
+    float base = rotations[0] * DEGTORAD;
+    return vec3(-reach * sinf(base), height, reach * cosf(base));
 }
 
-template<>
-void refineBoneToWholeAngles<NumBones>(BoneArray& currRots, BoneArray& baseRots, const TargetPoint& target, BoneArray& bestRots, vec3& bestPos, float& bestDistSq)
+vec3 calcHandPoint(const BoneArray& rotations)
 {
-    vec3 testPos = calcHandPoint(currRots);
-    float testDistSq = distance_sq(testPos, target.initialPos);
-    if (testDistSq < bestDistSq)
-    {
-        bestPos = testPos;
-        bestDistSq = testDistSq;
-        copy(currRots.begin(), currRots.end(), bestRots.begin());
-    }
+    return calcHandPointPlanar(rotations);
 }
 
 
-// take a good IK result and find the closest approximation that only uses whole-number angles
-void refineToWholeAngles(TargetPoint& target)
+// the planar chain's running state just before each joint, so poses that differ from a known pose in a single joint
+// only need the chain from that joint onwards. changing the base doesn't touch the planar chain at all
+struct FkPrefixCache
 {
-    static const float baseOffset = 1.f;
+    struct ChainState
+    {
+        float pitch;
+        float reach;
+        float height;
+    };
 
-    vec3 goalPos = target.initialPos;
+    BoneArray rotations;
+    array<ChainState, NumBones + 1> states;   // states[i] is the chain before bone i, for i >= SHOULDER
 
-    BoneArray baseRots;
-    for (size_t i = 0; i < baseRots.size(); ++i)
-        baseRots[i] = floorf(target.rots[i]) - baseOffset;
+    static ChainState step(const ChainState& state, int bone, float rotation)
+    {
+        ChainState next;
+        next.pitch = state.pitch - rotation * DEGTORAD;
+        next.reach = state.reach + gTranslations[bone] * sinf(next.pitch);
+        next.height = state.height + gTranslations[bone] * cosf(next.pitch);
+        return next;
+    }
 
-    float bestDistSq = FLT_MAX;
-    BoneArray bestRots;
-    vec3 bestPos;
+    static vec3 handPoint(const ChainState& state, float baseRotation)
+    {
+        float base = baseRotation * DEGTORAD;
+        return vec3(-state.reach * sinf(base), state.height, state.reach * cosf(base));
+    }
 
-    BoneArray currRots;
-    refineBoneToWholeAngles<BASE_ROT>(currRots, baseRots, target, bestRots, bestPos, bestDistSq);
+    explicit FkPrefixCache(const BoneArray& pose)
+        : rotations(pose)
+    {
+        states[SHOULDER] = { 0.f, 0.f, BASE_HEIGHT + gTranslations[BASE_ROT] };
+        for (int bone = SHOULDER; bone < NumBones; ++bone)
+            states[bone + 1] = step(states[bone], bone, rotations[bone]);
+    }
 
-    target.pos = bestPos;
-    copy(bestRots.begin(), bestRots.end(), target.rots.begin());
-}
+    vec3 handPoint() const
+    {
+        ++tFkEvaluations;
+        return handPoint(states[NumBones], rotations[BASE_ROT]);
+    }
 
+    // the hand point with rotations[bone] replaced by rotation
+    vec3 handPointWith(int bone, float rotation) const
+    {
+        ++tFkEvaluations;
+        if (bone == BASE_ROT)
+            return handPoint(states[NumBones], rotation);
+
+        ChainState state = step(states[bone], bone, rotation);
+        for (int next = bone + 1; next < NumBones; ++next)
+            state = step(state, next, rotations[next]);
+        return handPoint(state, rotations[BASE_ROT]);
+    }
+};
 
 
-static const float ikTolerance = 1.f;
+// ---------------------------------------------------------------------------------------------------------------------------
+// batched forward kinematics
+//
+// the solvers often want the hand position for lots of unrelated poses at once, so these evaluate the planar chain
+// from calcHandPointPlanar() across a structure-of-arrays batch, 8 or 16 poses at a time where the cpu allows
 
-// IK solver based on https://www.alanzucconi.com/2017/04/10/robotic-arms/
-void tickIKInternal(TargetPoint& target)
+// batches are padded to this many lanes so the kernels never need a scalar tail
+static const int FK_BATCH_PAD = 16;
+
+// poses are either free float angles or whole degrees, which get the table-driven kernels
+template<int Capacity, typename Angle = float>
+struct PoseBatch
 {
-    float deltaAngle = 0.25f;
-    float learningRate = 0.1f;
+    static_assert(Capacity % FK_BATCH_PAD == 0, "batch capacity must be a whole number of simd blocks");
+    using Pose = array<Angle, NumBones>;
 
-    vec3 currentPos = calcHandPoint(target.rots);
-    float currentDistance = glm::distance(currentPos, target.pos);
+    int count = 0;
+    alignas(64) Angle rots[NumBones][Capacity] = {};
+    alignas(64) float x[Capacity] = {};
+    alignas(64) float y[Capacity] = {};
+    alignas(64) float z[Capacity] = {};
 
-    // move more carefully when we get close
-    if (currentDistance < ikTolerance * 3.f)
+    int add(const Pose& pose)
     {
-        learningRate *= 0.25f;
-        deltaAngle *= 0.5f;
+        for (int bone = 0; bone < NumBones; ++bone)
+            rots[bone][count] = pose[bone];
+        return count++;
     }
 
-    // calculate all our gradients
-    BoneArray gradients;
-    for (size_t i = 0; i < target.rots.size(); ++i)
+    Pose pose(int index) const
     {
-        float oldAngle = target.rots[i];
-        target.rots[i] += deltaAngle;
+        Pose result;
+        for (int bone = 0; bone < NumBones; ++bone)
+            result[bone] = rots[bone][index];
+        return result;
+    }
 
-        vec3 testPos = calcHandPoint(target.rots);
-        float newDistance = glm::distance(testPos, target.pos);
-        float gradient = (newDistance - currentDistance) / deltaAngle;
+    vec3 pos(int index) const
+    {
+        return vec3(x[index], y[index], z[index]);
+    }
+};
 
-        gradients[i] = gradient;
+template<int Capacity>
+using WholePoseBatch = PoseBatch<Capacity, int>;
 
-        target.rots[i] = oldAngle;
+
+// sin and cos of every whole degree from -360 to 360, built at compile time so whole-angle poses never need a
+// transcendental call. the taylor series only ever sees 0-90 degrees, where it converges long before 12 terms
+static const int MAX_WHOLE_DEGREES = 360;
+
+constexpr double sinWholeDegrees(int degrees)
+{
+    degrees %= 360;
+    if (degrees < 0)
+        degrees += 360;
+
+    double sign = 1.0;
+    if (degrees >= 180)
+    {
+        degrees -= 180;
+        sign = -1.0;
     }
+    if (degrees > 90)
+        degrees = 180 - degrees;
 
-    // update all our angles
-    for (size_t i = 0; i < target.rots.size(); ++i)
+    double x = degrees * (3.14159265358979323846 / 180.0);
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; ++n)
     {
-        target.rots[i] -= learningRate * gradients[i];
+        term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+        sum += term;
     }
+    return sign * sum;
 }
 
-void tickIK(TargetPoint& target)
+constexpr array<float, 2 * MAX_WHOLE_DEGREES + 1> makeWholeDegreeTable(int phaseDegrees)
 {
-    tickIKInternal(target);
-
-    vec3 newPos = calcHandPoint(target.rots);
-    float newDistance = glm::distance(newPos, target.pos);
-    if (newDistance <= ikTolerance)
-    {
-        // we're within our tolerance, so we run the IK a few more times to try and get really close
-        for (int i = 0; i < 10; ++i)
-            tickIKInternal(target);
+    array<float, 2 * MAX_WHOLE_DEGREES + 1> table = {};
+    for (int degrees = -MAX_WHOLE_DEGREES; degrees <= MAX_WHOLE_DEGREES; ++degrees)
+        table[degrees + MAX_WHOLE_DEGREES] = (float)sinWholeDegrees(degrees + phaseDegrees);
+    return table;
+}
 
-        vec3 ikPos = calcHandPoint(target.rots);
-        float ikDistance = glm::distance(ikPos, target.pos);
+// index with degrees + MAX_WHOLE_DEGREES
+constexpr auto SIN_WHOLE_DEGREES = makeWholeDegreeTable(0);
+constexpr auto COS_WHOLE_DEGREES = makeWholeDegreeTable(90);
 
-        target.found = true;
-        target.pos = ikPos;
-        cout << "   found @ " << target << endl;
+// keeps a running sum of whole angles, each within +-360, inside the tables
+inline int wrapWholeDegrees(int degrees)
+{
+    if (degrees > MAX_WHOLE_DEGREES)
+        degrees -= 360;
+    else if (degrees < -MAX_WHOLE_DEGREES)
+        degrees += 360;
+    return degrees;
+}
 
-        refineToWholeAngles(target);
-        cout << "   refined to " << target << endl;
+// calcHandPointPlanar() for whole-degree poses, with every joint within +-360
+vec3 calcHandPointWhole(const WholeBoneArray& rotations)
+{
+    ++tFkEvaluations;
 
-        return;
+    float reach = 0.f;
+    float height = BASE_HEIGHT + gTranslations[0];
+    int pitch = 0;
+    for (size_t i = 1; i < NumBones; ++i)
+    {
+        pitch = wrapWholeDegrees(pitch - rotations[i]);
+        reach += gTranslations[i] * SIN_WHOLE_DEGREES[pitch + MAX_WHOLE_DEGREES];
+        height += gTranslations[i] * COS_WHOLE_DEGREES[pitch + MAX_WHOLE_DEGREES];
     }
 
-    copy(target.rots.begin(), target.rots.end(), gRotations.begin());
+    int base = rotations[0] + MAX_WHOLE_DEGREES;
+    return vec3(-reach * SIN_WHOLE_DEGREES[base], height, reach * COS_WHOLE_DEGREES[base]);
 }
 
 
-// ---------------------------------------------------------------------------------------------------------------------------
+// evaluates roundUp(count, FK_BATCH_PAD) poses
+using HandPointsKernel = void (*)(const float* const* rots, float* xs, float* ys, float* zs, int count);
+using WholeHandPointsKernel = void (*)(const int* const* rots, float* xs, float* ys, float* zs, int count);
 
-void writeResults()
+struct FkKernels
 {
-    ofstream ofs("roboboogie.h");
-    ofs << "// only two types of dances  x\n\n";
-
-    int minx = (int)TARGET_MIN_X / 10;
-    int maxx = (int)TARGET_MAX_X / 10;
-    int minz = (int)TARGET_MIN_Z / 10;
-    int maxz = (int)TARGET_MAX_Z / 10;
-
-    ofs << "namespace robo {\n";
-    ofs << "static const int MIN_X = " << minx << ";\n";
-    ofs << "static const int MAX_X = " << maxx << ";\n";
-    ofs << "static const int COUNT_X = " << (1 + maxx - minx) << ";\n";
-    ofs << "static const int MIN_Z = " << minz << ";\n";
-    ofs << "static const int MAX_Z = " << maxz << ";\n";
-    ofs << "static const int COUNT_Z = " << (1 + maxz - minz) << ";\n";
-    ofs << "\n\n// target height is " << (int)TARGET_Y << "mm from bottom of bokksu\n\n";
-
-    ofs << "// rotTable is a 2D array of 4 rotations: [BASE_ROT, SHOULDER, ELBOW, WRIST], representing positions in a 2D grid spaced 1cm apart\n";
-    ofs << "// The first element is at (MIN_X,MIN_Z), the fourth at (MIN_X+1,MIN_Z), and so on\n";
+    HandPointsKernel handPoints;
+    WholeHandPointsKernel wholeHandPoints;
+    bool batchGradientStep;     // whether a gradient step is quicker through these than through FkPrefixCache
+};
 
-    ofs << "static const char rotTable[COUNT_X * COUNT_Z * 4] PROGMEM = {\n";
-    for (const auto& target : gTargets)
+void calcHandPointsScalar(const float* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    for (int pose = 0; pose < count; ++pose)
     {
-        ofs << "  " << target.rots[0] << ", " << target.rots[1] << ", " << target.rots[2] << ", " << target.rots[3] << ", ";
-        ofs << "  // " << (((int)target.initialPos.x)/10) << "cm , " << (((int)target.initialPos.z)/10) << "cm\n";
+        BoneArray rotations;
+        for (int bone = 0; bone < NumBones; ++bone)
+            rotations[bone] = rots[bone][pose];
+
+        vec3 pos = calcHandPointPlanar(rotations);
+        xs[pose] = pos.x;
+        ys[pose] = pos.y;
+        zs[pose] = pos.z;
     }
-    ofs << "};\n\n";
+}
+
+void calcHandPointsWholeScalar(const int* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    for (int pose = 0; pose < count; ++pose)
+    {
+        WholeBoneArray rotations;
+        for (int bone = 0; bone < NumBones; ++bone)
+            rotations[bone] = rots[bone][pose];
+
+        vec3 pos = calcHandPointWhole(rotations);
+        xs[pose] = pos.x;
+        ys[pose] = pos.y;
+        zs[pose] = pos.z;
+    }
+}
+
+#ifdef GRIPPR_X86
+
+#if defined(__GNUC__) || defined(__clang__)
+// the shared kernel templates pass vectors around before being flattened into the per-target entry points below
+#pragma GCC diagnostic ignored "-Wpsabi"
+#define GRIPPR_TARGET_AVX2 __attribute__((target("avx2,fma"), flatten))
+#define GRIPPR_TARGET_AVX512 __attribute__((target("avx512f"), flatten))
+#define GRIPPR_SIMD_INLINE inline
+#else
+#define GRIPPR_TARGET_AVX2
+#define GRIPPR_TARGET_AVX512
+#define GRIPPR_SIMD_INLINE __forceinline
+#endif
+
+// the kernel is written once against these thin wrappers, and instantiated inside functions compiled for each target
+struct Avx2Ops
+{
+    using F = __m256;
+    using I = __m256i;
+    static const int WIDTH = 8;
+
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F load(const float* p) { return _mm256_load_ps(p); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE void store(float* p, F v) { _mm256_store_ps(p, v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F set1(float v) { return _mm256_set1_ps(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F add(F a, F b) { return _mm256_add_ps(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F fnmadd(F a, F b, F c) { return _mm256_fnmadd_ps(a, b, c); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I toInt(F v) { return _mm256_cvttps_epi32(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F toFloat(I v) { return _mm256_cvtepi32_ps(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I set1i(int v) { return _mm256_set1_epi32(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I andi(I a, I b) { return _mm256_and_si256(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I shl29(I a) { return _mm256_slli_epi32(a, 29); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F asFloat(I v) { return _mm256_castsi256_ps(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I asInt(F v) { return _mm256_castps_si256(v); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F xorBits(F a, I b) { return asFloat(_mm256_xor_si256(asInt(a), b)); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F select(I isZero, F ifZero, F ifNotZero)
+    {
+        return _mm256_blendv_ps(ifNotZero, ifZero, asFloat(_mm256_cmpeq_epi32(isZero, _mm256_setzero_si256())));
+    }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I loadi(const int* p) { return _mm256_load_si256((const __m256i*)p); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I subi(I a, I b) { return _mm256_sub_epi32(a, b); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE F gather(const float* table, I index) { return _mm256_i32gather_ps(table, index, 4); }
+    GRIPPR_TARGET_AVX2 static GRIPPR_SIMD_INLINE I wrapDegrees(I degrees)
+    {
+        degrees = _mm256_sub_epi32(degrees, _mm256_and_si256(_mm256_cmpgt_epi32(degrees, _mm256_set1_epi32(MAX_WHOLE_DEGREES)), _mm256_set1_epi32(360)));
+        return _mm256_add_epi32(degrees, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(-MAX_WHOLE_DEGREES), degrees), _mm256_set1_epi32(360)));
+    }
+};
+
+struct Avx512Ops
+{
+    using F = __m512;
+    using I = __m512i;
+    static const int WIDTH = 16;
+
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F load(const float* p) { return _mm512_load_ps(p); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE void store(float* p, F v) { _mm512_store_ps(p, v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F set1(float v) { return _mm512_set1_ps(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F add(F a, F b) { return _mm512_add_ps(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F fnmadd(F a, F b, F c) { return _mm512_fnmadd_ps(a, b, c); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I toInt(F v) { return _mm512_cvttps_epi32(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F toFloat(I v) { return _mm512_cvtepi32_ps(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I set1i(int v) { return _mm512_set1_epi32(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I andi(I a, I b) { return _mm512_and_si512(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I shl29(I a) { return _mm512_slli_epi32(a, 29); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F asFloat(I v) { return _mm512_castsi512_ps(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I asInt(F v) { return _mm512_castps_si512(v); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F xorBits(F a, I b) { return asFloat(_mm512_xor_si512(asInt(a), b)); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F select(I isZero, F ifZero, F ifNotZero)
+    {
+        return _mm512_mask_blend_ps(_mm512_cmpeq_epi32_mask(isZero, _mm512_setzero_si512()), ifNotZero, ifZero);
+    }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I loadi(const int* p) { return _mm512_load_si512(p); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I subi(I a, I b) { return _mm512_sub_epi32(a, b); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE F gather(const float* table, I index) { return _mm512_i32gather_ps(index, table, 4); }
+    GRIPPR_TARGET_AVX512 static GRIPPR_SIMD_INLINE I wrapDegrees(I degrees)
+    {
+        degrees = _mm512_mask_sub_epi32(degrees, _mm512_cmpgt_epi32_mask(degrees, _mm512_set1_epi32(MAX_WHOLE_DEGREES)), degrees, _mm512_set1_epi32(360));
+        return _mm512_mask_add_epi32(degrees, _mm512_cmplt_epi32_mask(degrees, _mm512_set1_epi32(-MAX_WHOLE_DEGREES)), degrees, _mm512_set1_epi32(360));
+    }
+};
+
+// cephes-style sincosf: reduce to +-pi/4 by octant, then pick the sin or cos polynomial and sign for each lane.
+// good to a couple of ulp for the few revolutions our angles ever span
+template<typename V>
+GRIPPR_SIMD_INLINE void sincosSimd(typename V::F angle, typename V::F& sinOut, typename V::F& cosOut)
+{
+    using F = typename V::F;
+    using I = typename V::I;
+
+    I signMask = V::set1i(0x80000000);
+    I sinSign = V::andi(V::asInt(angle), signMask);
+    F x = V::asFloat(V::andi(V::asInt(angle), V::set1i(0x7fffffff)));
+
+    I octant = V::toInt(V::mul(x, V::set1(1.27323954473516f)));
+    octant = V::andi(V::addi(octant, V::set1i(1)), V::set1i(~1));
+    F y = V::toFloat(octant);
+
+    sinSign = V::andi(V::asInt(V::xorBits(V::asFloat(sinSign), V::shl29(V::andi(octant, V::set1i(4))))), signMask);
+    I cosSign = V::shl29(V::andi(V::addi(octant, V::set1i(2)), V::set1i(4)));
+    I usePolyB = V::andi(octant, V::set1i(2));
+
+    x = V::fnmadd(y, V::set1(0.78515625f), x);
+    x = V::fnmadd(y, V::set1(2.4187564849853515625e-4f), x);
+    x = V::fnmadd(y, V::set1(3.77489497744594108e-8f), x);
+    F z = V::mul(x, x);
+
+    F polyCos = V::fmadd(V::set1(2.443315711809948e-5f), z, V::set1(-1.388731625493765e-3f));
+    polyCos = V::fmadd(polyCos, z, V::set1(4.166664568298827e-2f));
+    polyCos = V::mul(V::mul(polyCos, z), z);
+    polyCos = V::fnmadd(V::set1(0.5f), z, polyCos);
+    polyCos = V::add(polyCos, V::set1(1.f));
+
+    F polySin = V::fmadd(V::set1(-1.9515295891e-4f), z, V::set1(8.3321608736e-3f));
+    polySin = V::fmadd(polySin, z, V::set1(-1.6666654611e-1f));
+    polySin = V::fmadd(V::mul(polySin, z), x, x);
+
+    sinOut = V::xorBits(V::select(usePolyB, polySin, polyCos), sinSign);
+    cosOut = V::xorBits(V::select(usePolyB, polyCos, polySin), cosSign);
+}
+
+template<typename V>
+GRIPPR_SIMD_INLINE void calcHandPointsSimd(const float* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    using F = typename V::F;
+
+    const F degToRad = V::set1(DEGTORAD);
+    for (int first = 0; first < count; first += V::WIDTH)
+    {
+        F reach = V::set1(0.f);
+        F height = V::set1(BASE_HEIGHT + gTranslations[0]);
+        F pitch = V::set1(0.f);
+        F sinPitch, cosPitch;
+        for (int bone = 1; bone < NumBones; ++bone)
+        {
+            pitch = V::fnmadd(V::load(rots[bone] + first), degToRad, pitch);
+            sincosSimd<V>(pitch, sinPitch, cosPitch);
+            F length = V::set1(gTranslations[bone]);
+            reach = V::fmadd(length, sinPitch, reach);
+            height = V::fmadd(length, cosPitch, height);
+        }
+
+        F sinBase, cosBase;
+        sincosSimd<V>(V::mul(V::load(rots[0] + first), degToRad), sinBase, cosBase);
+        V::store(xs + first, V::sub(V::set1(0.f), V::mul(reach, sinBase)));
+        V::store(ys + first, height);
+        V::store(zs + first, V::mul(reach, cosBase));
+    }
+}
+
+// the same chain for whole-degree poses, gathering sin and cos from the tables instead of computing them
+template<typename V>
+GRIPPR_SIMD_INLINE void calcHandPointsWholeSimd(const int* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    using F = typename V::F;
+    using I = typename V::I;
+
+    const float* sinTable = SIN_WHOLE_DEGREES.data() + MAX_WHOLE_DEGREES;
+    const float* cosTable = COS_WHOLE_DEGREES.data() + MAX_WHOLE_DEGREES;
+    for (int first = 0; first < count; first += V::WIDTH)
+    {
+        F reach = V::set1(0.f);
+        F height = V::set1(BASE_HEIGHT + gTranslations[0]);
+        I pitch = V::set1i(0);
+        for (int bone = 1; bone < NumBones; ++bone)
+        {
+            pitch = V::wrapDegrees(V::subi(pitch, V::loadi(rots[bone] + first)));
+            F length = V::set1(gTranslations[bone]);
+            reach = V::fmadd(length, V::gather(sinTable, pitch), reach);
+            height = V::fmadd(length, V::gather(cosTable, pitch), height);
+        }
+
+        I base = V::loadi(rots[0] + first);
+        V::store(xs + first, V::sub(V::set1(0.f), V::mul(reach, V::gather(sinTable, base))));
+        V::store(ys + first, height);
+        V::store(zs + first, V::mul(reach, V::gather(cosTable, base)));
+    }
+}
+
+GRIPPR_TARGET_AVX2 void calcHandPointsAvx2(const float* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    calcHandPointsSimd<Avx2Ops>(rots, xs, ys, zs, count);
+}
+
+GRIPPR_TARGET_AVX512 void calcHandPointsAvx512(const float* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    calcHandPointsSimd<Avx512Ops>(rots, xs, ys, zs, count);
+}
+
+GRIPPR_TARGET_AVX2 void calcHandPointsWholeAvx2(const int* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    calcHandPointsWholeSimd<Avx2Ops>(rots, xs, ys, zs, count);
+}
+
+GRIPPR_TARGET_AVX512 void calcHandPointsWholeAvx512(const int* const* rots, float* xs, float* ys, float* zs, int count)
+{
+    calcHandPointsWholeSimd<Avx512Ops>(rots, xs, ys, zs, count);
+}
+
+#endif // GRIPPR_X86
+
+
+SimdLevel detectSimdLevel()
+{
+#if defined(GRIPPR_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return SimdLevel::Scalar;
+
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && osSavesYmm && ((_xgetbv(0) & 0xe6) == 0xe6);
+    if (avx512)
+        return SimdLevel::Avx512;
+    if (avx2 && fma && osSavesYmm)
+        return SimdLevel::Avx2;
+    return SimdLevel::Scalar;
+#elif defined(GRIPPR_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::Avx2;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Avx2: return "avx2";
+    case SimdLevel::Avx512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+// never hands back a kernel the cpu can't run, whatever was asked for
+FkKernels selectFkKernels(SimdLevel requested, SimdLevel* selected = nullptr)
+{
+    SimdLevel supported = detectSimdLevel();
+    SimdLevel level = (requested == SimdLevel::Auto || requested > supported) ? supported : requested;
+    if (selected)
+        *selected = level;
+
+#ifdef GRIPPR_X86
+    if (level == SimdLevel::Avx512)
+        return { calcHandPointsAvx512, calcHandPointsWholeAvx512, true };
+    if (level == SimdLevel::Avx2)
+        return { calcHandPointsAvx2, calcHandPointsWholeAvx2, true };
+#endif
+    return { calcHandPointsScalar, calcHandPointsWholeScalar, false };
+}
+
+FkKernels gFkKernels = { calcHandPointsScalar, calcHandPointsWholeScalar, false };
+
+template<int Capacity, typename Angle>
+void calcHandPoints(PoseBatch<Capacity, Angle>& batch)
+{
+    tFkEvaluations += batch.count;
+
+    const Angle* rots[NumBones];
+    for (int bone = 0; bone < NumBones; ++bone)
+        rots[bone] = batch.rots[bone];
+    int paddedCount = (batch.count + FK_BATCH_PAD - 1) / FK_BATCH_PAD * FK_BATCH_PAD;
+    if constexpr (is_same_v<Angle, int>)
+        gFkKernels.wholeHandPoints(rots, batch.x, batch.y, batch.z, paddedCount);
+    else
+        gFkKernels.handPoints(rots, batch.x, batch.y, batch.z, paddedCount);
+}
+
+
+// walks the same chain as calcHandPointReference(), also filling in how the hand moves per degree of each joint
+vec3 calcHandJacobian(span<const float> rotations, array<vec3, NumBones>& jacobian)
+{
+    ++tFkEvaluations;
+
+    mat4 transform(1.f);
+
+    transform = glm::translate(transform, vec3(0.f, BASE_HEIGHT, 0.f));
+
+    vec3 haxis(-1.f, 0.f, 0.f);
+    vec3 vaxis(0.f, -1.f, 0.f);
+    array<vec3, NumBones> pivots;
+    array<vec3, NumBones> axes;
+    for (size_t i = 0; i < rotations.size(); ++i)
+    {
+        const vec3& axis = (i != 0) ? haxis : vaxis;
+        pivots[i] = transform[3];
+        axes[i] = transform * glm::vec4(axis, 0.f);
+        transform = glm::rotate(transform, rotations[i] * DEGTORAD, axis);
+        transform = glm::translate(transform, vec3(0.f, gTranslations[i], 0.f));
+    }
+
+    vec3 handPos = transform[3];
+    for (size_t i = 0; i < rotations.size(); ++i)
+        jacobian[i] = glm::cross(axes[i], handPos - pivots[i]) * DEGTORAD;
+
+    return handPos;
+}
+
+
+ostream& operator<<(ostream& os, const TargetPoint& target)
+{
+    for (span<const float> rots(target.rots); const float& rot : rots)
+    {
+        if (rot != rots.front())
+            os << ", ";
+        os << rot;
+    }
+    vec3 pos = calcHandPoint(target.rots);
+    float dist = glm::distance(target.initialPos, pos);
+    os << " (" << dist << " away)";
+    return os;
+}
+
+
+
+// the original fixed window: 4 whole angles per joint starting just below each solved angle
+static const int numRefinementGuesses = 4;
+static const int numRefinementPoses = numRefinementGuesses * numRefinementGuesses * numRefinementGuesses * numRefinementGuesses;
+static_assert(NumBones == 4, "numRefinementPoses assumes four bones");
+
+static const int MAX_REFINE_WINDOW = 10;
+
+// branch and bound over whole-degree poses within +-window of the solved angles. the base yaw fixes the arm's plane,
+// so the search tries bases outermost and then only ever works in that plane: the hand can't get any closer to the
+// goal than the goal's distance from the plane, plus the gap between the goal and the ring the rest of the chain can
+// sweep around the next joint. any subtree whose bound can't beat the best pose so far is skipped. candidates are
+// tried closest-to-the-solution first so a good best pose turns up early
+struct WholeAngleSearch
+{
+    vec3 goal;
+    array<int, NumBones> numCandidates;
+    array<array<int, 2 * MAX_REFINE_WINDOW>, NumBones> candidates;
+    array<float, NumBones + 1> remainingMinReach;
+    array<float, NumBones + 1> remainingMaxReach;
+    array<int, NumBones + 1> subtreePoses;
+
+    // the goal in the plane of the current base rotation
+    float planeGoalReach;
+    float planeOffsetSq;
+    float baseSin;
+    float baseCos;
+
+    WholeBoneArray currRots;
+    WholeBoneArray bestRots;
+    vec3 bestPos;
+    float bestDistSq = FLT_MAX;
+
+    int evaluations = 0;
+    int pruned = 0;
+};
+
+// the planar chain up to (not including) some joint
+struct WholeChainPrefix
+{
+    int pitch;
+    float reach;
+    float height;
+};
+
+template<int BoneId>
+void refineBoneToWholeAngles(const WholeChainPrefix& prefix, WholeAngleSearch& search)
+{
+    // the rest of the chain puts the hand somewhere on a ring around this joint
+    float reachGap = search.planeGoalReach - prefix.reach;
+    float heightGap = search.goal.y - prefix.height;
+    float jointDist = sqrtf(reachGap * reachGap + heightGap * heightGap);
+    float ringGap = max(0.f, max(jointDist - search.remainingMaxReach[BoneId], search.remainingMinReach[BoneId] - jointDist));
+    if (search.planeOffsetSq + ringGap * ringGap >= search.bestDistSq)
+    {
+        search.pruned += search.subtreePoses[BoneId];
+        return;
+    }
+
+    for (int guess = 0; guess < search.numCandidates[BoneId]; ++guess)
+    {
+        int rot = search.candidates[BoneId][guess];
+        search.currRots[BoneId] = rot;
+
+        WholeChainPrefix next;
+        next.pitch = wrapWholeDegrees(prefix.pitch - rot);
+        next.reach = prefix.reach + gTranslations[BoneId] * SIN_WHOLE_DEGREES[next.pitch + MAX_WHOLE_DEGREES];
+        next.height = prefix.height + gTranslations[BoneId] * COS_WHOLE_DEGREES[next.pitch + MAX_WHOLE_DEGREES];
+
+        refineBoneToWholeAngles<BoneId + 1>(next, search);
+    }
+}
+
+template<>
+void refineBoneToWholeAngles<NumBones>(const WholeChainPrefix& prefix, WholeAngleSearch& search)
+{
+    ++search.evaluations;
+
+    vec3 testPos(-prefix.reach * search.baseSin, prefix.height, prefix.reach * search.baseCos);
+    float testDistSq = distance_sq(testPos, search.goal);
+    if (testDistSq < search.bestDistSq)
+    {
+        search.bestDistSq = testDistSq;
+        search.bestPos = testPos;
+        search.bestRots = search.currRots;
+    }
+}
+
+
+// take a good IK result and find the closest approximation that only uses whole-number angles
+void refineToWholeAngles(TargetPoint& target)
+{
+    int window = clamp(gOptions.refineWindow, 1, MAX_REFINE_WINDOW);
+
+    // keep every candidate inside the whole-degree sin/cos tables
+    int maxRot = MAX_WHOLE_DEGREES - window;
+
+    WholeAngleSearch search;
+    search.goal = target.initialPos;
+    for (int bone = 0; bone < NumBones; ++bone)
+    {
+        float rot = clamp(target.rots[bone], (float)-maxRot, (float)maxRot);
+        auto& candidates = search.candidates[bone];
+        int& numCandidates = search.numCandidates[bone];
+        numCandidates = 0;
+        for (int guess = 0; guess < 2 * window; ++guess)
+        {
+            int candidate = (int)floorf(rot) - window + 1 + guess;
+            if (isRefinementCandidate(bone, rot, candidate))
+                candidates[numCandidates++] = candidate;
+        }
+        sort(candidates.begin(), candidates.begin() + numCandidates,
+            [rot](int a, int b) { return fabsf(a - rot) < fabsf(b - rot); });
+    }
+
+    // the reach of the links from each joint on, with the joints left free
+    search.remainingMinReach[NumBones] = search.remainingMaxReach[NumBones] = 0.f;
+    search.subtreePoses[NumBones] = 1;
+    float longest = 0.f;
+    for (int bone = NumBones - 1; bone >= SHOULDER; --bone)
+    {
+        longest = max(longest, gTranslations[bone]);
+        search.remainingMaxReach[bone] = search.remainingMaxReach[bone + 1] + gTranslations[bone];
+        search.remainingMinReach[bone] = max(0.f, 2.f * longest - search.remainingMaxReach[bone]);
+        search.subtreePoses[bone] = search.subtreePoses[bone + 1] * search.numCandidates[bone];
+    }
+
+    WholeChainPrefix start = { 0, 0.f, BASE_HEIGHT + gTranslations[BASE_ROT] };
+    for (int guess = 0; guess < search.numCandidates[BASE_ROT]; ++guess)
+    {
+        int base = search.candidates[BASE_ROT][guess];
+        search.currRots[BASE_ROT] = base;
+        search.baseSin = SIN_WHOLE_DEGREES[base + MAX_WHOLE_DEGREES];
+        search.baseCos = COS_WHOLE_DEGREES[base + MAX_WHOLE_DEGREES];
+
+        // split the goal into along the arm's plane and across it
+        float planeOffset = search.goal.x * search.baseCos + search.goal.z * search.baseSin;
+        search.planeGoalReach = search.baseCos * search.goal.z - search.baseSin * search.goal.x;
+        search.planeOffsetSq = planeOffset * planeOffset;
+
+        refineBoneToWholeAngles<SHOULDER>(start, search);
+    }
+
+    tFkEvaluations += search.evaluations;
+    target.refineEvaluations = search.evaluations;
+    target.refinePruned = search.pruned;
+
+    target.pos = search.bestPos;
+    for (size_t i = 0; i < search.bestRots.size(); ++i)
+        target.rots[i] = (float)search.bestRots[i];
+}
+
+
+
+static const float ikTolerance = 1.f;
+
+// IK solver based on https://www.alanzucconi.com/2017/04/10/robotic-arms/. each perturbation only changes one joint, so
+// it only redoes the chain from that joint on
+void tickIKInternalPrefix(TargetPoint& target)
+{
+    float deltaAngle = 0.25f;
+    float learningRate = 0.1f;
+
+    FkPrefixCache chain(target.rots);
+    vec3 currentPos = chain.handPoint();
+    float currentDistance = glm::distance(currentPos, target.pos);
+
+    // move more carefully when we get close
+    if (currentDistance < ikTolerance * 3.f)
+    {
+        learningRate *= 0.25f;
+        deltaAngle *= 0.5f;
+    }
+
+    // calculate all our gradients
+    BoneArray gradients;
+    for (size_t i = 0; i < target.rots.size(); ++i)
+    {
+        vec3 testPos = chain.handPointWith((int)i, target.rots[i] + deltaAngle);
+        float newDistance = glm::distance(testPos, target.pos);
+        float gradient = (newDistance - currentDistance) / deltaAngle;
+
+        gradients[i] = gradient;
+    }
+
+    // update all our angles
+    for (size_t i = 0; i < target.rots.size(); ++i)
+    {
+        target.rots[i] -= learningRate * gradients[i];
+    }
+}
+
+// ...and through the batch kernels. the step size depends on the current distance, so this evaluates the current pose
+// and the perturbations for both step sizes in one go. that's twice the poses, but with 8 or 16 lanes they come
+// nearly free, where without simd the prefix cache's partial chains win
+void tickIKInternalBatched(TargetPoint& target)
+{
+    float deltaAngle = 0.25f;
+    float learningRate = 0.1f;
+
+    PoseBatch<FK_BATCH_PAD> batch;
+    int currentIndex = batch.add(target.rots);
+    int firstTestIndex[2];
+    for (int fine = 0; fine < 2; ++fine)
+    {
+        firstTestIndex[fine] = batch.count;
+        float delta = fine ? deltaAngle * 0.5f : deltaAngle;
+        for (size_t i = 0; i < target.rots.size(); ++i)
+        {
+            BoneArray testRots = target.rots;
+            testRots[i] += delta;
+            batch.add(testRots);
+        }
+    }
+    calcHandPoints(batch);
+
+    float currentDistance = glm::distance(batch.pos(currentIndex), target.pos);
+
+    // move more carefully when we get close
+    bool fine = false;
+    if (currentDistance < ikTolerance * 3.f)
+    {
+        learningRate *= 0.25f;
+        deltaAngle *= 0.5f;
+        fine = true;
+    }
+
+    BoneArray gradients;
+    for (size_t i = 0; i < target.rots.size(); ++i)
+    {
+        float newDistance = glm::distance(batch.pos(firstTestIndex[fine] + (int)i), target.pos);
+        gradients[i] = (newDistance - currentDistance) / deltaAngle;
+    }
+    for (size_t i = 0; i < target.rots.size(); ++i)
+        target.rots[i] -= learningRate * gradients[i];
+}
+
+void tickIKInternal(TargetPoint& target)
+{
+    if (gFkKernels.batchGradientStep)
+        tickIKInternalBatched(target);
+    else
+        tickIKInternalPrefix(target);
+}
+
+
+// closed-form IK for the Braccio: the base yaw points the arm plane at the target, which leaves a planar 3-link problem.
+// that has one redundant degree of freedom, so we keep the seed's wrist approach angle (the pen's angle from vertical)
+// where we can, and otherwise take the nearest approach angle that can reach with every pitch joint inside the servo
+// range. the seed also picks the elbow branch. returns false if nothing fits, leaving the target untouched for the
+// gradient solver to have a go at.
+bool solveIKAnalytic(TargetPoint& target)
+{
+    static const float approachSearchStep = 0.5f;
+    static const float verifyTolerance = 0.01f;
+
+    const BoneArray& seed = target.rots;
+    const vec3& goal = target.pos;
+
+    // the chain swings round -Y, so world x = -reach * sin(base), z = reach * cos(base)
+    float base = atan2f(-goal.x, goal.z) * RADTODEG;
+    base += 360.f * roundf((seed[BASE_ROT] - base) / 360.f);
+
+    // in the arm plane each link adds (L sin psi, L cos psi) to (reach, height), where psi is the negated sum of the
+    // pitch joints so far
+    float reach = sqrtf(goal.x * goal.x + goal.z * goal.z);
+    float height = goal.y - BASE_HEIGHT - gTranslations[BASE_ROT];
+    float upperLen = gTranslations[SHOULDER];
+    float lowerLen = gTranslations[ELBOW];
+    float handLen = gTranslations[WRIST];
+
+    float elbowSign = (seed[ELBOW] <= 0.f) ? 1.f : -1.f;
+    float seedApproach = -(seed[SHOULDER] + seed[ELBOW] + seed[WRIST]);
+
+    for (float offset = 0.f; offset <= 180.f; offset += approachSearchStep)
+    {
+        for (float dir : { 1.f, -1.f })
+        {
+            if (offset == 0.f && dir < 0.f)
+                continue;
+
+            float approach = seedApproach + dir * offset;
+            float wristReach = reach - handLen * sinf(approach * DEGTORAD);
+            float wristHeight = height - handLen * cosf(approach * DEGTORAD);
+
+            float wristDistSq = wristReach * wristReach + wristHeight * wristHeight;
+            float cosElbow = (wristDistSq - upperLen * upperLen - lowerLen * lowerLen) / (2.f * upperLen * lowerLen);
+            if (cosElbow < -1.f || cosElbow > 1.f)
+                continue;
+
+            float elbowBend = elbowSign * acosf(cosElbow);
+            float upperPsi = atan2f(wristReach, wristHeight) - atan2f(lowerLen * sinf(elbowBend), upperLen + lowerLen * cosf(elbowBend));
+            float lowerPsi = upperPsi + elbowBend;
+
+            BoneArray rots;
+            rots[BASE_ROT] = base;
+            rots[SHOULDER] = -upperPsi * RADTODEG;
+            rots[ELBOW] = -elbowBend * RADTODEG;
+            rots[WRIST] = lowerPsi * RADTODEG - approach;
+
+            bool inServoRange = true;
+            for (int j = SHOULDER; j < NumBones; ++j)
+                inServoRange = inServoRange && rots[j] >= SERVO_MIN_DEGREES && rots[j] <= SERVO_MAX_DEGREES;
+            if (!inServoRange)
+                continue;
+
+            // cross-check against the real FK so a geometry slip can never sneak into the table
+            if (glm::distance(calcHandPointReference(rots), goal) > verifyTolerance)
+                return false;
+
+            target.rots = rots;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Levenberg-Marquardt style damped least squares: each step solves (J J^T + lambda^2 I) y = error and moves by J^T y,
+// which is the smallest joint move that closes the error, with lambda growing when a step overshoots and shrinking
+// while steps keep paying off. returns false if it runs out of iterations without getting within ikTolerance.
+bool solveIKDampedLeastSquares(TargetPoint& target)
+{
+    static const int maxIterations = 100;
+    static const float convergedDistance = 0.001f;
+    static const float minDamping = 0.01f;
+    static const float maxDamping = 1000.f;
+
+    float damping = 1.f;
+    array<vec3, NumBones> jacobian;
+    vec3 currentPos = calcHandJacobian(target.rots, jacobian);
+    float currentDistSq = distance_sq(currentPos, target.pos);
+
+    int iteration = 0;
+    for (; iteration < maxIterations && currentDistSq > convergedDistance * convergedDistance; ++iteration)
+    {
+        vec3 error = target.pos - currentPos;
+
+        // J J^T is a symmetric 3x3, so just invert it directly
+        float a[3][3];
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int col = 0; col < 3; ++col)
+            {
+                a[row][col] = 0.f;
+                for (int bone = 0; bone < NumBones; ++bone)
+                    a[row][col] += jacobian[bone][row] * jacobian[bone][col];
+            }
+            a[row][row] += damping * damping;
+        }
+
+        float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+        float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+        float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+        float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+        if (fabsf(det) < 1e-12f)
+            break;
+
+        float invDet = 1.f / det;
+        vec3 y;
+        y.x = (c00 * error.x + (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * error.y + (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * error.z) * invDet;
+        y.y = (c01 * error.x + (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * error.y + (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * error.z) * invDet;
+        y.z = (c02 * error.x + (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * error.y + (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * error.z) * invDet;
+
+        BoneArray trialRots;
+        for (int bone = 0; bone < NumBones; ++bone)
+            trialRots[bone] = target.rots[bone] + glm::dot(jacobian[bone], y);
+
+        vec3 trialPos = calcHandPoint(trialRots);
+        float trialDistSq = distance_sq(trialPos, target.pos);
+        if (trialDistSq < currentDistSq)
+        {
+            target.rots = trialRots;
+            currentPos = calcHandJacobian(target.rots, jacobian);
+            currentDistSq = distance_sq(currentPos, target.pos);
+            damping = max(damping * 0.5f, minDamping);
+        }
+        else
+        {
+            damping *= 4.f;
+            if (damping > maxDamping)
+                break;
+        }
+    }
+
+    target.iterations += iteration;
+    return currentDistSq <= ikTolerance * ikTolerance;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// workspace map. the base can turn the arm to face anything, so whether a target is reachable only depends on how far
+// it is from the base horizontally and how high it is. sweep the other joints through the batched fk, marking the
+// (distance, height) cells the hand lands in, so targets outside that can be rejected before we spend any time on them
+
+class WorkspaceMap
+{
+public:
+    void build()
+    {
+        float shoulderHeight = BASE_HEIGHT + gTranslations[BASE_ROT];
+        float maxReach = 0.f;
+        for (int bone = 1; bone < NumBones; ++bone)
+            maxReach += gTranslations[bone];
+
+        float margin = (DILATE_CELLS + 1) * CELL_MM;
+        mMinY = shoulderHeight - maxReach - margin;
+        mCountR = (int)((maxReach + margin) / CELL_MM) + 1;
+        mCountY = (int)((2.f * (maxReach + margin)) / CELL_MM) + 1;
+        vector<uint8_t> hits((size_t)mCountR * mCountY, 0);
+
+        auto batch = make_unique<WholePoseBatch<1024>>();
+        auto markBatch = [&]()
+        {
+            calcHandPoints(*batch);
+            for (int pose = 0; pose < batch->count; ++pose)
+            {
+                // with the base at 0 the arm reaches along z, and reaching backwards is just turning the base round
+                int r = (int)(fabsf(batch->z[pose]) / CELL_MM);
+                int y = (int)((batch->y[pose] - mMinY) / CELL_MM);
+                if (r < mCountR && y >= 0 && y < mCountY)
+                    hits[(size_t)y * mCountR + r] = 1;
+            }
+            batch->count = 0;
+        };
+
+        // only the poses the servos can actually take: the pitch joints are limited just like the base
+        for (int shoulder = SERVO_MIN_DEGREES; shoulder <= SERVO_MAX_DEGREES; shoulder += SAMPLE_DEGREES)
+        {
+            for (int elbow = SERVO_MIN_DEGREES; elbow <= SERVO_MAX_DEGREES; elbow += SAMPLE_DEGREES)
+            {
+                for (int wrist = SERVO_MIN_DEGREES; wrist <= SERVO_MAX_DEGREES; wrist += SAMPLE_DEGREES)
+                {
+                    batch->add({ 0, shoulder, elbow, wrist });
+                    if (batch->count == 1024)
+                        markBatch();
+                }
+            }
+        }
+        if (batch->count > 0)
+            markBatch();
+
+        // the samples are SAMPLE_DEGREES apart, which leaves gaps between the cells they mark, most of all towards the
+        // edge of the envelope where only a fully stretched arm gets. grow the marked cells just enough to close them:
+        // it's better to try a target we can't reach than to refuse one we can
+        mCells.assign(hits.size(), 0);
+        for (int y = 0; y < mCountY; ++y)
+        {
+            for (int r = 0; r < mCountR; ++r)
+            {
+                if (!hits[(size_t)y * mCountR + r])
+                    continue;
+                for (int dy = max(0, y - DILATE_CELLS); dy <= min(mCountY - 1, y + DILATE_CELLS); ++dy)
+                    for (int dr = max(0, r - DILATE_CELLS); dr <= min(mCountR - 1, r + DILATE_CELLS); ++dr)
+                        mCells[(size_t)dy * mCountR + dr] = 1;
+            }
+        }
+    }
+
+    bool canReach(vec3 pos) const
+    {
+        int r = (int)(sqrtf(pos.x * pos.x + pos.z * pos.z) / CELL_MM);
+        int y = (int)floorf((pos.y - mMinY) / CELL_MM);
+        return r < mCountR && y >= 0 && y < mCountY && mCells[(size_t)y * mCountR + r];
+    }
+
+    size_t numReachableCells() const
+    {
+        return (size_t)count(mCells.begin(), mCells.end(), 1);
+    }
+
+    size_t numCells() const
+    {
+        return mCells.size();
+    }
+
+private:
+    static const int CELL_MM = 5;
+    static const int SAMPLE_DEGREES = 2;
+    static const int DILATE_CELLS = 2;
+
+    float mMinY = 0.f;
+    int mCountR = 0;
+    int mCountY = 0;
+    vector<uint8_t> mCells;
+};
+
+WorkspaceMap gWorkspaceMap;
+bool gUseWorkspaceMap = false;
+
+
+// one step of solving target. returns true once it's done with, which doesn't mean it was found: check its status
+bool tickIK(TargetPoint& target)
+{
+    if (target.iterations == 0 && gUseWorkspaceMap && !gWorkspaceMap.canReach(target.initialPos))
+    {
+        // the table still needs whole degrees here, so round wherever the seed left us
+        target.status = TargetStatus::Unreachable;
+        target.ikRots = target.rots;
+        for (float& rot : target.rots)
+            rot = roundf(rot);
+        if (gOptions.verbose)
+        {
+            lock_guard<mutex> lock(gLogMutex);
+            cout << "   unreachable, skipping" << endl;
+        }
+        return true;
+    }
+
+    int64_t fkEvaluationsBefore = tFkEvaluations;
+
+    bool solved = false;
+    if (target.iterations == 0 && gOptions.solver == SolverType::Analytic)
+    {
+        ++target.iterations;
+        solved = solveIKAnalytic(target);
+    }
+    else if (target.iterations == 0 && gOptions.solver == SolverType::DampedLeastSquares)
+    {
+        solved = solveIKDampedLeastSquares(target);
+    }
+
+    if (!solved)
+    {
+        ++target.iterations;
+        tickIKInternal(target);
+
+        vec3 newPos = calcHandPoint(target.rots);
+        float newDistance = glm::distance(newPos, target.pos);
+        if (newDistance <= ikTolerance)
+        {
+            // we're within our tolerance, so we run the IK a few more times to try and get really close
+            for (int i = 0; i < 10; ++i)
+                tickIKInternal(target);
+            target.iterations += 10;
+            solved = true;
+        }
+    }
+
+    if (!solved)
+    {
+        target.fkEvaluations += (int)(tFkEvaluations - fkEvaluationsBefore);
+
+        if (target.iterations >= gOptions.maxIterations)
+        {
+            target.status = TargetStatus::GaveUp;
+            target.ikRots = target.rots;
+            for (float& rot : target.rots)
+                rot = roundf(rot);
+            if (gOptions.verbose)
+            {
+                lock_guard<mutex> lock(gLogMutex);
+                cout << "   gave up after " << target.iterations << " iterations @ " << target << endl;
+            }
+        }
+    }
+
+    if (solved)
+    {
+        vec3 ikPos = calcHandPoint(target.rots);
+        target.fkEvaluations += (int)(tFkEvaluations - fkEvaluationsBefore);
+
+        target.status = TargetStatus::Found;
+        target.pos = ikPos;
+        target.ikRots = target.rots;
+        if (gOptions.verbose)
+        {
+            lock_guard<mutex> lock(gLogMutex);
+            cout << "   found @ " << target << endl;
+        }
+
+        refineToWholeAngles(target);
+        if (gOptions.verbose)
+        {
+            lock_guard<mutex> lock(gLogMutex);
+            cout << "   refined to " << target << endl;
+        }
+    }
+
+    return target.status != TargetStatus::Solving;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+
+struct GridShape
+{
+    int countX;
+    int countZ;
+};
+
+// stepping exactly the way update() does, so the counts always agree with it
+GridShape targetGridShape()
+{
+    GridShape shape = { 0, 0 };
+    for (float x = TARGET_MIN_X; x <= TARGET_MAX_X; x += TARGET_STEP_X)
+        ++shape.countX;
+    for (float z = TARGET_MIN_Z; z <= TARGET_MAX_Z; z += TARGET_STEP_Z)
+        ++shape.countZ;
+    return shape;
+}
+
+// all the grid targets in the same order update() visits them, which is the order writeResults() expects
+vector<TargetPoint> makeTargetGrid(float y = TARGET_Y)
+{
+    vector<TargetPoint> targets;
+    for (float z = TARGET_MIN_Z; z <= TARGET_MAX_Z; z += TARGET_STEP_Z)
+    {
+        for (float x = TARGET_MIN_X; x <= TARGET_MAX_X; x += TARGET_STEP_X)
+        {
+            TargetPoint& target = targets.emplace_back();
+            target.rots = REST_ROTATIONS;
+            target.pos = target.initialPos = vec3(x, y, z);
+        }
+    }
+    return targets;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// solve cache. solved targets are appended to a file named after a hash of everything that affects the solution, so a
+// re-run with the same kinematics only solves targets it hasn't seen, and a run that's interrupted picks up where it
+// stopped. change anything in the hash and you get a different file. the iterative solvers can land on different
+// solutions from different seeds, and the seeds depend on the solve order, mirroring, and whether it's the grid or the
+// volume being solved, so each record is keyed on the seed as well as the target
+
+// bump this whenever a change to the solvers or refinement would change their results
+static const int SOLVER_VERSION = 2;
+
+class SolveCache
+{
+public:
+    // opens (or starts) the cache for the current parameters in dir
+    bool open(const string& dir)
+    {
+        uint64_t hash = parameterHash();
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)hash);
+
+        error_code error;
+        filesystem::create_directories(dir, error);
+        mPath = (filesystem::path(dir) / name).string();
+
+        // a run that was killed part way through a record leaves a partial one at the end, which we drop
+        size_t size = filesystem::exists(mPath, error) ? (size_t)filesystem::file_size(mPath, error) : 0;
+        size_t numRecords = size / sizeof(Record);
+        if (size != numRecords * sizeof(Record))
+            filesystem::resize_file(mPath, numRecords * sizeof(Record), error);
+
+        ifstream ifs(mPath, ios::binary);
+        Record record;
+        while (ifs.read((char*)&record, sizeof(record)))
+            mRecords[keyHash(record.key)] = record;
+
+        mOfs.open(mPath, ios::binary | ios::app);
+        if (!mOfs)
+        {
+            cerr << "couldn't open the solve cache " << mPath << endl;
+            return false;
+        }
+        cout << "solve cache " << mPath << ": " << mRecords.size() << " targets" << endl;
+        return true;
+    }
+
+    // fills in target from the cache if we've solved it before from the seed in its rots, and lastRots with the pose
+    // solveTarget would have handed on, so a hit seeds the rest of a sequential solve the same way a fresh solve would
+    bool lookup(TargetPoint& target, BoneArray* lastRots)
+    {
+        Key key = makeKey(target.initialPos, target.rots);
+        auto it = mRecords.find(keyHash(key));
+        if (it == mRecords.end() || it->second.key != key)
+        {
+            ++mMisses;
+            return false;
+        }
+
+        const Record& record = it->second;
+        target.status = TargetStatus::Found;
+        target.pos = vec3(record.pos[0], record.pos[1], record.pos[2]);
+        for (int j = 0; j < NumBones; ++j)
+        {
+            target.rots[j] = record.rots[j];
+            target.ikRots[j] = record.ikRots[j];
+        }
+        if (lastRots && record.stepped)
+            copy(record.lastStepRots, record.lastStepRots + NumBones, lastRots->begin());
+        ++mHits;
+        return true;
+    }
+
+    // appends a freshly solved target, flushed straight away so an interrupted run keeps it
+    void store(const TargetPoint& target, const BoneArray& seed, const BoneArray* lastStep)
+    {
+        Record record = {};
+        record.key = makeKey(target.initialPos, seed);
+        record.pos[0] = target.pos.x;
+        record.pos[1] = target.pos.y;
+        record.pos[2] = target.pos.z;
+        for (int j = 0; j < NumBones; ++j)
+        {
+            record.ikRots[j] = target.ikRots[j];
+            record.rots[j] = (int8_t)target.rots[j];
+        }
+        if (lastStep)
+        {
+            record.stepped = 1;
+            copy(lastStep->begin(), lastStep->end(), record.lastStepRots);
+        }
+
+        lock_guard<mutex> lock(mMutex);
+        mOfs.write((const char*)&record, sizeof(record));
+        mOfs.flush();
+    }
+
+    int64_t hits() const { return mHits; }
+    int64_t misses() const { return mMisses; }
+
+private:
+    // the target position in hundredths of a mm, then the seed in hundredths of a degree
+    using Key = array<int32_t, 3 + NumBones>;
+
+    struct Record
+    {
+        Key key;
+        float pos[3];           // where the refined pose actually puts the hand
+        float ikRots[NumBones];
+        int8_t rots[NumBones];
+        float lastStepRots[NumBones]; // the pose from the step before it converged, if it took any
+        int8_t stepped;
+    };
+
+    static Key makeKey(vec3 pos, const BoneArray& seed)
+    {
+        Key key = { (int32_t)lroundf(pos.x * 100.f), (int32_t)lroundf(pos.y * 100.f), (int32_t)lroundf(pos.z * 100.f) };
+        for (int j = 0; j < NumBones; ++j)
+            key[3 + j] = (int32_t)lroundf(seed[j] * 100.f);
+        return key;
+    }
+
+    // FNV-1a. lookup() checks the whole key, so a collision is only a miss
+    static uint64_t keyHash(const Key& key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (int32_t value : key)
+            hash = (hash ^ (uint32_t)value) * 1099511628211ull;
+        return hash;
+    }
+
+    // FNV-1a over everything that changes what a target solves to
+    static uint64_t parameterHash()
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&](const auto& value)
+        {
+            const uint8_t* bytes = (const uint8_t*)&value;
+            for (size_t i = 0; i < sizeof(value); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        };
+        add(SOLVER_VERSION);
+        add(gTranslations);
+        add(BASE_HEIGHT);
+        add(REST_ROTATIONS);
+        add(ikTolerance);
+        add(gOptions.solver);
+        add(gOptions.refineWindow);
+        add(gFkKernels.batchGradientStep);
+        // the workspace map turns targets away before they're ever solved
+        add(gUseWorkspaceMap);
+        add(sizeof(Record));
+        return hash;
+    }
+
+    string mPath;
+    unordered_map<uint64_t, Record> mRecords;
+    ofstream mOfs;
+    mutex mMutex;
+    atomic<int64_t> mHits = 0;
+    atomic<int64_t> mMisses = 0;
+};
+
+SolveCache* gSolveCache = nullptr;
+
+// solves a target from wherever its rots are now, or pulls it out of the solve cache if there is one. lastRots gets
+// the pose from the last step before it was solved, which is what the sequential solve warm-starts the next one from
+void solveTarget(TargetPoint& target, BoneArray* lastRots = nullptr)
+{
+    BoneArray seed = target.rots;
+    if (gSolveCache && gSolveCache->lookup(target, lastRots))
+        return;
+
+    bool stepped = false;
+    BoneArray lastStep;
+    while (!tickIK(target))
+    {
+        stepped = true;
+        lastStep = target.rots;
+        if (lastRots)
+            *lastRots = target.rots;
+    }
+
+    if (gSolveCache && target.status == TargetStatus::Found)
+        gSolveCache->store(target, seed, stepped ? &lastStep : nullptr);
+}
+
+
+// a deliberately simple locked deque: each task is a whole IK solve, so contention on the lock is negligible
+class WorkQueue
+{
+public:
+    void push(int task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        mTasks.push_back(task);
+    }
+
+    // owners work front-to-back so consecutive tasks are neighbouring cells...
+    bool pop(int& task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mTasks.empty())
+            return false;
+        task = mTasks.front();
+        mTasks.pop_front();
+        return true;
+    }
+
+    // ...while thieves take from the back, as far away from the owner as possible
+    bool steal(int& task)
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mTasks.empty())
+            return false;
+        task = mTasks.back();
+        mTasks.pop_back();
+        return true;
+    }
+
+private:
+    mutex mMutex;
+    deque<int> mTasks;
+};
+
+
+// seeds a grid cell from the IK solutions of the cells before it in x and z, which the wavefront order guarantees are
+// solved: the parallelogram rule when we have the left, lower and diagonal cells, otherwise a straight-line
+// extrapolation from the two cells before it along an edge, otherwise the one neighbour we have
+BoneArray neighbourSeed(const vector<TargetPoint>& targets, GridShape shape, int task)
+{
+    int ix = task % shape.countX;
+    int iz = task / shape.countX;
+    auto ikRots = [&](int x, int z) -> const BoneArray& { return targets[z * shape.countX + x].ikRots; };
+
+    BoneArray seed = REST_ROTATIONS;
+    for (int bone = 0; bone < NumBones; ++bone)
+    {
+        if (ix > 0 && iz > 0)
+            seed[bone] = ikRots(ix - 1, iz)[bone] + ikRots(ix, iz - 1)[bone] - ikRots(ix - 1, iz - 1)[bone];
+        else if (ix > 1)
+            seed[bone] = 2.f * ikRots(ix - 1, iz)[bone] - ikRots(ix - 2, iz)[bone];
+        else if (ix > 0)
+            seed[bone] = ikRots(ix - 1, iz)[bone];
+        else if (iz > 1)
+            seed[bone] = 2.f * ikRots(ix, iz - 1)[bone] - ikRots(ix, iz - 2)[bone];
+        else if (iz > 0)
+            seed[bone] = ikRots(ix, iz - 1)[bone];
+    }
+    return seed;
+}
+
+
+// solve every target of the grid using a pool of workers, writing results in place so the order of targets is
+// unchanged whatever the scheduling.
+//
+// in row-major order the work is handed out a grid row at a time. each row starts from the rest pose and warm-starts
+// each solve from the one before it, like the sequential solve does with gRotations. workers own a contiguous run of
+// rows and steal whole rows from the far end of someone else's, so a cell's seed only depends on its row, never on
+// which worker got there or when.
+//
+// in wavefront order a cell becomes ready once the cells before it in x and z are solved, and is seeded from them by
+// neighbourSeed(). the ready cells form a diagonal front sweeping across the grid, so there's still plenty to share
+// out, and the seeds (and so the results) no longer depend on the scheduling at all.
+void solveTargetsParallel(vector<TargetPoint>& targets, GridShape shape, int numThreads, SolveOrder order)
+{
+    if (numThreads <= 0)
+        numThreads = max(1, (int)thread::hardware_concurrency());
+    numThreads = min(numThreads, max(1, (int)targets.size()));
+
+    vector<WorkQueue> queues(numThreads);
+    vector<atomic<int>> pendingNeighbours(targets.size());
+    if (order == SolveOrder::RowMajor)
+    {
+        for (int worker = 0; worker < numThreads; ++worker)
+        {
+            int begin = shape.countZ * worker / numThreads;
+            int end = shape.countZ * (worker + 1) / numThreads;
+            for (int row = begin; row < end; ++row)
+                queues[worker].push(row);
+        }
+    }
+    else
+    {
+        for (int task = 0; task < (int)targets.size(); ++task)
+            pendingNeighbours[task] = (task % shape.countX > 0 ? 1 : 0) + (task / shape.countX > 0 ? 1 : 0);
+        if (!targets.empty())
+            queues[0].push(0);
+    }
+    atomic<int> remaining = (int)targets.size();
+
+    auto workerMain = [&](int worker)
+    {
+        while (remaining > 0)
+        {
+            int task;
+            if (!queues[worker].pop(task))
+            {
+                bool gotOne = false;
+                for (int offset = 1; offset < numThreads && !gotOne; ++offset)
+                    gotOne = queues[(worker + offset) % numThreads].steal(task);
+                if (!gotOne)
+                {
+                    // in row-major order everything was queued up front, so empty queues mean we're done. the
+                    // wavefront may just be waiting on someone else's cell to free up more
+                    if (order == SolveOrder::RowMajor)
+                        return;
+                    this_thread::yield();
+                    continue;
+                }
+            }
+
+            if (order == SolveOrder::RowMajor)
+            {
+                // in row-major order a task is a whole row
+                BoneArray seedRots = REST_ROTATIONS;
+                for (int ix = 0; ix < shape.countX; ++ix)
+                {
+                    TargetPoint& target = targets[task * shape.countX + ix];
+                    target.rots = seedRots;
+                    solveTarget(target, &seedRots);
+                }
+                remaining -= shape.countX;
+                continue;
+            }
+
+            TargetPoint& target = targets[task];
+            target.rots = neighbourSeed(targets, shape, task);
+            solveTarget(target);
+
+            // the cells after this one in x and z may now have everything they need
+            if (task % shape.countX + 1 < shape.countX && --pendingNeighbours[task + 1] == 0)
+                queues[worker].push(task + 1);
+            if (task / shape.countX + 1 < shape.countZ && --pendingNeighbours[task + shape.countX] == 0)
+                queues[worker].push(task + shape.countX);
+            --remaining;
+        }
+    };
+
+    vector<thread> workers;
+    for (int worker = 1; worker < numThreads; ++worker)
+        workers.emplace_back(workerMain, worker);
+    workerMain(0);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+// the arm is symmetric about x = 0: a target's mirror image has the base rotation negated and every other joint the
+// same. so only solve the columns with x >= 0, and fill in the rest by mirroring them
+void solveTargetsMirrored(vector<TargetPoint>& targets, GridShape shape, int numThreads, SolveOrder order)
+{
+    GridShape halfShape = { 0, shape.countZ };
+    for (int ix = 0; ix < shape.countX; ++ix)
+        if (targets[ix].initialPos.x >= 0.f)
+            ++halfShape.countX;
+    int firstHalfColumn = shape.countX - halfShape.countX;
+
+    vector<TargetPoint> halfTargets;
+    halfTargets.reserve((size_t)halfShape.countX * halfShape.countZ);
+    for (int iz = 0; iz < shape.countZ; ++iz)
+        for (int ix = firstHalfColumn; ix < shape.countX; ++ix)
+            halfTargets.push_back(targets[iz * shape.countX + ix]);
+
+    solveTargetsParallel(halfTargets, halfShape, numThreads, order);
+
+    for (int iz = 0; iz < shape.countZ; ++iz)
+    {
+        for (int ix = 0; ix < shape.countX; ++ix)
+        {
+            TargetPoint& target = targets[iz * shape.countX + ix];
+            if (ix >= firstHalfColumn)
+            {
+                target = halfTargets[iz * halfShape.countX + ix - firstHalfColumn];
+                continue;
+            }
+
+            const TargetPoint& mirror = halfTargets[iz * halfShape.countX + (shape.countX - 1 - ix) - firstHalfColumn];
+            target.status = mirror.status;
+            target.pos = vec3(-mirror.pos.x, mirror.pos.y, mirror.pos.z);
+            target.rots = mirror.rots;
+            target.rots[BASE_ROT] = -mirror.rots[BASE_ROT];
+            target.ikRots = mirror.ikRots;
+            target.ikRots[BASE_ROT] = -mirror.ikRots[BASE_ROT];
+        }
+    }
+}
+
+// mirroring needs the grid to be symmetric about x = 0
+bool canMirrorTargetGrid()
+{
+    return TARGET_MIN_X == -TARGET_MAX_X;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// table encodings. neighbouring cells differ by a few degrees and the pitch joints only cover a narrow range, so the table
+// packs down a lot. each encoding has a host decoder here that matches the one written into the header, and every cell is
+// round-tripped through it before the header is written
+
+// the cells that go into the table, row-major. with --half-table only the x >= 0 columns are stored
+struct TableCells
+{
+    int countX = 0;
+    int countZ = 0;
+    vector<WholeBoneArray> rots;
+};
+
+TableCells collectTableCells(bool halfTable)
+{
+    TableCells cells;
+    GridShape shape = targetGridShape();
+    cells.countZ = shape.countZ;
+    for (const auto& target : gTargets)
+    {
+        if (halfTable && target.initialPos.x < 0.f)
+            continue;
+        WholeBoneArray& rots = cells.rots.emplace_back();
+        for (int j = 0; j < NumBones; ++j)
+            rots[j] = (int)target.rots[j];
+    }
+    cells.countX = cells.countZ ? (int)cells.rots.size() / cells.countZ : 0;
+    return cells;
+}
+
+// row delta tables restart from a raw cell every this many cells, so decoding one never sums more than 7 deltas
+static const int DELTA_RUN_CELLS = 8;
+static const int DELTA_RUN_BYTES = NumBones + (DELTA_RUN_CELLS - 1) * NumBones / 2;
+// and mark a row that has to be stored raw with this bit in its slot
+static const int DELTA_RAW_ROW = 0x80;
+
+struct EncodedTable
+{
+    TableEncoding encoding = TableEncoding::Raw;
+    vector<uint8_t> bytes;
+
+    // row delta: a slot byte per row, then the delta rows, then any raw rows. a delta row is runs of DELTA_RUN_CELLS
+    // cells, each the 4 raw rotations of its first cell then a signed nibble delta per joint for the rest. a row with a
+    // delta that doesn't fit in a nibble is stored raw instead, and its slot has DELTA_RAW_ROW set
+    int rowBytes = 0;
+    int deltaRowsStart = 0;
+    int rawRowsStart = 0;
+    int numRawRows = 0;
+
+    // bit pack: each cell is cellBits bits, lsb first. joint j is (rot - jointBias[j]) in jointBits[j] bits at jointShift[j]
+    int cellBits = 0;
+    WholeBoneArray jointBias = {};
+    WholeBoneArray jointBits = {};
+    WholeBoneArray jointShift = {};
+};
+
+const char* tableEncodingName(TableEncoding encoding)
+{
+    switch (encoding)
+    {
+    case TableEncoding::RowDelta: return "delta";
+    case TableEncoding::BitPack: return "bitpack";
+    default: return "raw";
+    }
+}
+
+bool encodeTable(const TableCells& cells, TableEncoding encoding, EncodedTable& table)
+{
+    table = EncodedTable();
+    table.encoding = encoding;
+
+    if (encoding == TableEncoding::Raw)
+    {
+        for (const auto& rots : cells.rots)
+            for (int rot : rots)
+                table.bytes.push_back((uint8_t)(int8_t)rot);
+        return true;
+    }
+
+    if (encoding == TableEncoding::RowDelta)
+    {
+        // the slots only have 7 bits for a row's place in its half of the table
+        if (cells.countZ > DELTA_RAW_ROW)
+            return false;
+
+        int numRuns = (cells.countX + DELTA_RUN_CELLS - 1) / DELTA_RUN_CELLS;
+        table.rowBytes = cells.countX * NumBones / 2 + numRuns * NumBones / 2;
+        table.deltaRowsStart = cells.countZ;
+        table.bytes.resize(cells.countZ);
+        vector<uint8_t> rawRows;
+        int numDeltaRows = 0;
+        for (int row = 0; row < cells.countZ; ++row)
+        {
+            const WholeBoneArray* rowRots = &cells.rots[(size_t)row * cells.countX];
+            vector<uint8_t> packedRow;
+            bool fits = true;
+            for (int col = 0; col < cells.countX && fits; ++col)
+            {
+                if (col % DELTA_RUN_CELLS == 0)
+                {
+                    for (int rot : rowRots[col])
+                        packedRow.push_back((uint8_t)(int8_t)rot);
+                    continue;
+                }
+
+                uint8_t packed = 0;
+                for (int j = 0; j < NumBones; ++j)
+                {
+                    int delta = rowRots[col][j] - rowRots[col - 1][j];
+                    if (delta < -8 || delta > 7)
+                    {
+                        fits = false;
+                        break;
+                    }
+
+                    packed |= (uint8_t)((delta & 15) << ((j & 1) * 4));
+                    if (j & 1)
+                    {
+                        packedRow.push_back(packed);
+                        packed = 0;
+                    }
+                }
+            }
+
+            if (fits)
+            {
+                table.bytes[row] = (uint8_t)numDeltaRows++;
+                table.bytes.insert(table.bytes.end(), packedRow.begin(), packedRow.end());
+            }
+            else
+            {
+                table.bytes[row] = (uint8_t)(DELTA_RAW_ROW | table.numRawRows++);
+                for (int col = 0; col < cells.countX; ++col)
+                    for (int rot : rowRots[col])
+                        rawRows.push_back((uint8_t)(int8_t)rot);
+            }
+        }
+        table.rawRowsStart = (int)table.bytes.size();
+        table.bytes.insert(table.bytes.end(), rawRows.begin(), rawRows.end());
+        return true;
+    }
+
+    // bit pack, with each joint's width taken from the range it actually covers
+    WholeBoneArray minRot, maxRot;
+    minRot.fill(127);
+    maxRot.fill(-128);
+    for (const auto& rots : cells.rots)
+    {
+        for (int j = 0; j < NumBones; ++j)
+        {
+            minRot[j] = min(minRot[j], rots[j]);
+            maxRot[j] = max(maxRot[j], rots[j]);
+        }
+    }
+
+    for (int j = 0; j < NumBones; ++j)
+    {
+        table.jointBias[j] = minRot[j];
+        table.jointShift[j] = table.cellBits;
+        while ((1 << table.jointBits[j]) <= maxRot[j] - minRot[j])
+            ++table.jointBits[j];
+        table.cellBits += table.jointBits[j];
+    }
+
+    // one byte of padding so the decoder can always read two bytes
+    size_t totalBits = cells.rots.size() * table.cellBits;
+    table.bytes.assign((totalBits + 7) / 8 + 1, 0);
+    size_t cellBit = 0;
+    for (const auto& rots : cells.rots)
+    {
+        for (int j = 0; j < NumBones; ++j)
+        {
+            uint32_t value = (uint32_t)(rots[j] - table.jointBias[j]);
+            for (int b = 0; b < table.jointBits[j]; ++b)
+            {
+                size_t bit = cellBit + table.jointShift[j] + b;
+                if (value & (1u << b))
+                    table.bytes[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+            }
+        }
+        cellBit += table.cellBits;
+    }
+    return true;
+}
+
+// host copy of the decodeCell() written into the header
+void decodeTableCell(const EncodedTable& table, int countX, int col, int row, int8_t out[NumBones])
+{
+    const uint8_t* bytes = table.bytes.data();
+    if (table.encoding == TableEncoding::Raw)
+    {
+        const uint8_t* cell = bytes + ((size_t)row * countX + col) * NumBones;
+        for (int j = 0; j < NumBones; ++j)
+            out[j] = (int8_t)cell[j];
+    }
+    else if (table.encoding == TableEncoding::RowDelta)
+    {
+        int slot = bytes[row];
+        if (slot & DELTA_RAW_ROW)
+        {
+            const uint8_t* cell = bytes + table.rawRowsStart + ((size_t)(slot & ~DELTA_RAW_ROW) * countX + col) * NumBones;
+            for (int j = 0; j < NumBones; ++j)
+                out[j] = (int8_t)cell[j];
+            return;
+        }
+
+        const uint8_t* p = bytes + table.deltaRowsStart + (size_t)slot * table.rowBytes + (col / DELTA_RUN_CELLS) * DELTA_RUN_BYTES;
+        for (int j = 0; j < NumBones; ++j)
+            out[j] = (int8_t)p[j];
+        p += NumBones;
+        for (int c = col % DELTA_RUN_CELLS; c > 0; --c, p += 2)
+        {
+            out[0] += (int8_t)(((p[0] & 15) ^ 8) - 8);
+            out[1] += (int8_t)(((p[0] >> 4) ^ 8) - 8);
+            out[2] += (int8_t)(((p[1] & 15) ^ 8) - 8);
+            out[3] += (int8_t)(((p[1] >> 4) ^ 8) - 8);
+        }
+    }
+    else
+    {
+        uint32_t cellBit = (uint32_t)(row * countX + col) * table.cellBits;
+        for (int j = 0; j < NumBones; ++j)
+        {
+            uint32_t bit = cellBit + table.jointShift[j];
+            const uint8_t* p = bytes + (bit >> 3);
+            uint32_t word = p[0] | ((uint32_t)p[1] << 8);
+            out[j] = (int8_t)(table.jointBias[j] + (int)((word >> (bit & 7)) & ((1u << table.jointBits[j]) - 1)));
+        }
+    }
+}
+
+// decodes every cell and checks it against what was encoded
+bool verifyEncodedTable(const TableCells& cells, const EncodedTable& table)
+{
+    for (int row = 0; row < cells.countZ; ++row)
+    {
+        for (int col = 0; col < cells.countX; ++col)
+        {
+            int8_t decoded[NumBones];
+            decodeTableCell(table, cells.countX, col, row, decoded);
+            const WholeBoneArray& rots = cells.rots[(size_t)row * cells.countX + col];
+            for (int j = 0; j < NumBones; ++j)
+            {
+                if (decoded[j] != rots[j])
+                {
+                    cerr << tableEncodingName(table.encoding) << " table round trip failed at column " << col << ", row " << row
+                        << ": joint " << j << " is " << (int)decoded[j] << ", expected " << rots[j] << endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// packed tables are written as hex, 16 bytes to a line
+void writeTableBytes(ostream& os, const vector<uint8_t>& bytes)
+{
+    static const char* hexDigits = "0123456789abcdef";
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        if (i % 16 == 0)
+            os << "  ";
+        os << "0x" << hexDigits[bytes[i] >> 4] << hexDigits[bytes[i] & 15] << ",";
+        os << ((i % 16 == 15 || i + 1 == bytes.size()) ? "\n" : " ");
+    }
+}
+
+// writes the packed table and a decodeCell(col, row, out) for it. the raw table is written by writeResults() itself
+void writeTableDecoder(ostream& os, const EncodedTable& table)
+{
+    if (table.encoding == TableEncoding::Raw)
+    {
+        os << "static inline void decodeCell(int col, int row, char out[4])\n";
+        os << "{\n";
+        os << "  const char* cell = rotTable + (row * TABLE_COUNT_X + col) * 4;\n";
+        os << "  out[0] = (char)pgm_read_byte(cell);\n";
+        os << "  out[1] = (char)pgm_read_byte(cell + 1);\n";
+        os << "  out[2] = (char)pgm_read_byte(cell + 2);\n";
+        os << "  out[3] = (char)pgm_read_byte(cell + 3);\n";
+        os << "}\n\n";
+    }
+    else if (table.encoding == TableEncoding::RowDelta)
+    {
+        os << "// the table starts with a slot byte per row, then the delta rows, then any raw rows. a delta row is runs of RUN_CELLS cells,\n";
+        os << "// each the 4 rotations of its first cell then a signed 4 bit delta per joint for the rest, low nibble first, so decoding\n";
+        os << "// a cell sums at most RUN_CELLS - 1 deltas. a row with a delta that doesn't fit in 4 bits is stored raw, and its slot has\n";
+        os << "// the top bit set\n";
+        os << "static const int ROW_BYTES = " << table.rowBytes << ";\n";
+        os << "static const int RUN_CELLS = " << DELTA_RUN_CELLS << ";\n";
+        os << "static const int RUN_BYTES = " << DELTA_RUN_BYTES << ";\n";
+        os << "static const int DELTA_ROWS_START = " << table.deltaRowsStart << ";\n";
+        os << "static const int RAW_ROWS_START = " << table.rawRowsStart << ";\n";
+        os << "static const unsigned char packedTable[" << table.bytes.size() << "] PROGMEM = {\n";
+        writeTableBytes(os, table.bytes);
+        os << "};\n\n";
+
+        os << "static inline void decodeCell(int col, int row, char out[4])\n";
+        os << "{\n";
+        os << "  unsigned char slot = pgm_read_byte(packedTable + row);\n";
+        os << "  const unsigned char* p;\n";
+        os << "  if (slot & 0x80)\n";
+        os << "    p = packedTable + RAW_ROWS_START + ((slot & 0x7f) * TABLE_COUNT_X + col) * 4;\n";
+        os << "  else\n";
+        os << "    p = packedTable + DELTA_ROWS_START + slot * ROW_BYTES + (col / RUN_CELLS) * RUN_BYTES;\n";
+        os << "  out[0] = (char)pgm_read_byte(p);\n";
+        os << "  out[1] = (char)pgm_read_byte(p + 1);\n";
+        os << "  out[2] = (char)pgm_read_byte(p + 2);\n";
+        os << "  out[3] = (char)pgm_read_byte(p + 3);\n";
+        os << "  if (slot & 0x80)\n";
+        os << "    return;\n";
+        os << "\n";
+        os << "  p += 4;\n";
+        os << "  for (int c = col % RUN_CELLS; c > 0; --c, p += 2)\n";
+        os << "  {\n";
+        os << "    unsigned char lo = pgm_read_byte(p);\n";
+        os << "    unsigned char hi = pgm_read_byte(p + 1);\n";
+        os << "    out[0] += ((lo & 15) ^ 8) - 8;\n";
+        os << "    out[1] += ((lo >> 4) ^ 8) - 8;\n";
+        os << "    out[2] += ((hi & 15) ^ 8) - 8;\n";
+        os << "    out[3] += ((hi >> 4) ^ 8) - 8;\n";
+        os << "  }\n";
+        os << "}\n\n";
+    }
+    else
+    {
+        os << "// each cell is " << table.cellBits << " bits, lsb first. each joint is stored as (rotation - bias) in just enough bits for its range\n";
+        os << "static const int CELL_BITS = " << table.cellBits << ";\n";
+        os << "static const unsigned char packedTable[" << table.bytes.size() << "] PROGMEM = {\n";
+        writeTableBytes(os, table.bytes);
+        os << "};\n\n";
+
+        os << "static inline char decodeJoint(unsigned long bit, int bias, unsigned int mask)\n";
+        os << "{\n";
+        os << "  const unsigned char* p = packedTable + (bit >> 3);\n";
+        os << "  unsigned int word = pgm_read_byte(p) | ((unsigned int)pgm_read_byte(p + 1) << 8);\n";
+        os << "  return (char)(bias + (int)((word >> (bit & 7)) & mask));\n";
+        os << "}\n\n";
+
+        os << "static inline void decodeCell(int col, int row, char out[4])\n";
+        os << "{\n";
+        os << "  unsigned long cellBit = (unsigned long)(row * TABLE_COUNT_X + col) * CELL_BITS;\n";
+        for (int j = 0; j < NumBones; ++j)
+        {
+            os << "  out[" << j << "] = decodeJoint(cellBit + " << table.jointShift[j] << ", " << table.jointBias[j]
+                << ", " << ((1u << table.jointBits[j]) - 1) << "u);\n";
+        }
+        os << "}\n\n";
+    }
+}
+
+// how big the table comes out in each encoding
+void reportTableEncodings(const TableCells& cells)
+{
+    size_t rawBytes = cells.rots.size() * NumBones;
+    for (TableEncoding encoding : { TableEncoding::Raw, TableEncoding::RowDelta, TableEncoding::BitPack })
+    {
+        EncodedTable table;
+        cout << tableEncodingName(encoding) << " table: ";
+        if (!encodeTable(cells, encoding, table))
+            cout << "doesn't fit this encoding" << endl;
+        else if (!verifyEncodedTable(cells, table))
+            cout << "round trip failed" << endl;
+        else
+        {
+            cout << table.bytes.size() << " bytes (" << (100 * table.bytes.size() / rawBytes) << "% of raw)";
+            if (table.numRawRows > 0)
+                cout << ", " << table.numRawRows << " of " << cells.countZ << " rows stored raw";
+            cout << endl;
+        }
+    }
+}
+
+
+// host copy of the lookupMm() written into the header, over the full grid. blends the 4 cells around (xMm,zMm) with
+// weights in hundredths of a cell, so everything stays in 16 bit integers on the robot
+void interpolateTableMm(const TableCells& cells, int xMm, int zMm, WholeBoneArray& out)
+{
+    int ox = clamp(xMm - ((int)TARGET_MIN_X / 10) * 10, 0, (cells.countX - 1) * TABLE_CELL_X_MM);
+    int oz = clamp(zMm - ((int)TARGET_MIN_Z / 10) * 10, 0, (cells.countZ - 1) * TABLE_CELL_Z_MM);
+    int ix = ox / TABLE_CELL_X_MM;
+    int iz = oz / TABLE_CELL_Z_MM;
+    int fx = ox - ix * TABLE_CELL_X_MM;
+    int fz = oz - iz * TABLE_CELL_Z_MM;
+    if (ix == cells.countX - 1)
+    {
+        --ix;
+        fx = TABLE_CELL_X_MM;
+    }
+    if (iz == cells.countZ - 1)
+    {
+        --iz;
+        fz = TABLE_CELL_Z_MM;
+    }
+
+    const WholeBoneArray& c00 = cells.rots[(size_t)iz * cells.countX + ix];
+    const WholeBoneArray& c10 = cells.rots[(size_t)iz * cells.countX + ix + 1];
+    const WholeBoneArray& c01 = cells.rots[(size_t)(iz + 1) * cells.countX + ix];
+    const WholeBoneArray& c11 = cells.rots[(size_t)(iz + 1) * cells.countX + ix + 1];
+    int w00 = (TABLE_CELL_X_MM - fx) * (TABLE_CELL_Z_MM - fz);
+    int w10 = fx * (TABLE_CELL_Z_MM - fz);
+    int w01 = (TABLE_CELL_X_MM - fx) * fz;
+    int w11 = fx * fz;
+    const int cellArea = TABLE_CELL_X_MM * TABLE_CELL_Z_MM;
+    for (int j = 0; j < NumBones; ++j)
+    {
+        int sum = w00 * c00[j] + w10 * c10[j] + w01 * c01[j] + w11 * c11[j];
+        out[j] = (sum + (sum < 0 ? -cellArea / 2 : cellArea / 2)) / cellArea;
+    }
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// table writers, for output that's streamed rather than formatted all at the end
+
+struct VolumeShape
+{
+    GridShape grid;
+    float minY;
+    float stepY;
+    int countY;
+};
+
+// where volume tables go. levels arrive in order, each one row-major like gTargets
+class TableWriter
+{
+public:
+    virtual ~TableWriter() = default;
+
+    virtual bool begin(const VolumeShape& shape) = 0;
+    virtual bool writeLevel(float y, span<const TargetPoint> targets) = 0;
+    virtual bool end() = 0;
+
+    size_t bytesWritten() const { return mBytesWritten; }
+
+protected:
+    // hands a finished chunk to the stream in one go
+    bool flush(ofstream& ofs, string& chunk)
+    {
+        ofs.write(chunk.data(), (streamsize)chunk.size());
+        mBytesWritten += chunk.size();
+        chunk.clear();
+        return (bool)ofs;
+    }
+
+    size_t mBytesWritten = 0;
+};
+
+// writes robovolume.h. each level is formatted into a chunk with to_chars, which is a lot quicker than going
+// through ofstream << a number at a time
+class HeaderTableWriter : public TableWriter
+{
+public:
+    explicit HeaderTableWriter(const char* path)
+        : mOfs(path, ios::binary)
+    {
+    }
+
+    bool begin(const VolumeShape& shape) override
+    {
+        int minx = (int)TARGET_MIN_X / 10;
+        int minz = (int)TARGET_MIN_Z / 10;
+
+        mChunk += "// rotations over a stack of grids at different heights\n\n";
+        mChunk += "namespace robo {\n";
+        mChunk += "static const int VOL_MIN_X = " + to_string(minx) + ";\n";
+        mChunk += "static const int VOL_COUNT_X = " + to_string(shape.grid.countX) + ";\n";
+        mChunk += "static const int VOL_MIN_Z = " + to_string(minz) + ";\n";
+        mChunk += "static const int VOL_COUNT_Z = " + to_string(shape.grid.countZ) + ";\n";
+        mChunk += "static const int VOL_MIN_Y_MM = " + to_string((int)shape.minY) + ";\n";
+        mChunk += "static const int VOL_STEP_Y_MM = " + to_string((int)shape.stepY) + ";\n";
+        mChunk += "static const int VOL_COUNT_Y = " + to_string(shape.countY) + ";\n\n";
+        mChunk += "// volumeTable is VOL_COUNT_Y levels, lowest first, each laid out like rotTable: 4 rotations [BASE_ROT, SHOULDER, ELBOW, WRIST]\n";
+        mChunk += "// for each point of a 2D grid spaced 1cm apart, starting at (VOL_MIN_X,VOL_MIN_Z)\n";
+        mChunk += "static const char volumeTable[VOL_COUNT_Y * VOL_COUNT_Z * VOL_COUNT_X * 4] PROGMEM = {\n";
+        return flush(mOfs, mChunk);
+    }
+
+    bool writeLevel(float y, span<const TargetPoint> targets) override
+    {
+        mChunk += "  // y = " + to_string((int)y) + "mm\n";
+        for (const auto& target : targets)
+        {
+            // "  -128, -128, -128, -128,\n" is the longest a cell gets
+            char line[32];
+            char* p = line;
+            *p++ = ' ';
+            for (float rot : target.rots)
+            {
+                *p++ = ' ';
+                p = to_chars(p, line + sizeof(line), (int)rot).ptr;
+                *p++ = ',';
+            }
+            *p++ = '\n';
+            mChunk.append(line, p);
+        }
+        return flush(mOfs, mChunk);
+    }
+
+    bool end() override
+    {
+        mChunk += "};\n\n";
+        mChunk += "// fills out with the 4 rotations for the grid point (x,z), in cm, on level yLevel\n";
+        mChunk += "static inline void lookupVolume(int x, int yLevel, int z, char out[4])\n";
+        mChunk += "{\n";
+        mChunk += "  const char* cell = volumeTable + ((yLevel * VOL_COUNT_Z + (z - VOL_MIN_Z)) * VOL_COUNT_X + (x - VOL_MIN_X)) * 4;\n";
+        mChunk += "  out[0] = (char)pgm_read_byte(cell);\n";
+        mChunk += "  out[1] = (char)pgm_read_byte(cell + 1);\n";
+        mChunk += "  out[2] = (char)pgm_read_byte(cell + 2);\n";
+        mChunk += "  out[3] = (char)pgm_read_byte(cell + 3);\n";
+        mChunk += "}\n\n";
+        mChunk += "} // namespace robo\n";
+        return flush(mOfs, mChunk);
+    }
+
+private:
+    ofstream mOfs;
+    string mChunk;
+};
+
+// writes the versioned binary format robotable.h reads: a header, padding up to the aligned payload, then the cells.
+// the checksum is worked out as the levels stream past, and the header is rewritten with it at the end
+class BinaryTableWriter : public TableWriter
+{
+public:
+    explicit BinaryTableWriter(const char* path)
+        : mOfs(path, ios::binary)
+    {
+    }
+
+    bool begin(const VolumeShape& shape) override
+    {
+        memset(&mHeader, 0, sizeof(mHeader));
+        memcpy(mHeader.magic, ROBOTABLE_MAGIC, sizeof(mHeader.magic));
+        mHeader.version = ROBOTABLE_VERSION;
+        mHeader.headerSize = sizeof(RoboTableHeader);
+        mHeader.minX = (int16_t)((int)TARGET_MIN_X / 10);
+        mHeader.minZ = (int16_t)((int)TARGET_MIN_Z / 10);
+        mHeader.countX = (uint16_t)shape.grid.countX;
+        mHeader.countZ = (uint16_t)shape.grid.countZ;
+        mHeader.countY = (uint16_t)shape.countY;
+        mHeader.stepXZ = (uint16_t)TARGET_STEP_X;
+        mHeader.minY = (int16_t)shape.minY;
+        mHeader.stepY = (int16_t)shape.stepY;
+        mHeader.encoding = ROBOTABLE_ENCODING_RAW;
+        mHeader.cellBytes = NumBones;
+        mHeader.payloadOffset = ROBOTABLE_PAYLOAD_ALIGNMENT;
+        mHeader.checksum = robotableChecksum(nullptr, 0);
+
+        mChunk.assign(mHeader.payloadOffset, '\0');
+        return flush(mOfs, mChunk);
+    }
+
+    bool writeLevel(float, span<const TargetPoint> targets) override
+    {
+        for (const auto& target : targets)
+            for (float rot : target.rots)
+                mChunk.push_back((char)(int8_t)rot);
+        mHeader.payloadBytes += (uint32_t)mChunk.size();
+        mHeader.checksum = robotableChecksum(mChunk.data(), mChunk.size(), mHeader.checksum);
+        return flush(mOfs, mChunk);
+    }
+
+    bool end() override
+    {
+        mOfs.seekp(0);
+        mOfs.write((const char*)&mHeader, sizeof(mHeader));
+        mOfs.flush();
+        return (bool)mOfs;
+    }
+
+private:
+    ofstream mOfs;
+    string mChunk;
+    RoboTableHeader mHeader;
+};
+
+
+// writes gTargets in the robotable.h format, then maps it back in the way host tools will and checks every cell
+bool writeBinaryTable(const char* path)
+{
+    {
+        BinaryTableWriter writer(path);
+        VolumeShape shape = { targetGridShape(), TARGET_Y, 0.f, 1 };
+        if (!writer.begin(shape) || !writer.writeLevel(TARGET_Y, gTargets) || !writer.end())
+        {
+            cerr << "couldn't write " << path << endl;
+            return false;
+        }
+    }
+
+    auto startTime = chrono::high_resolution_clock::now();
+    RoboTable table;
+    const char* error = nullptr;
+    if (!table.open(path, &error))
+    {
+        cerr << "couldn't read back " << path << ": " << error << endl;
+        return false;
+    }
+    double openSecs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    if (!table.verifyChecksum())
+    {
+        cerr << path << " has a bad checksum" << endl;
+        return false;
+    }
+    for (const auto& target : gTargets)
+    {
+        const int8_t* cell = table.cell((int)target.initialPos.x / 10, (int)target.initialPos.z / 10);
+        for (int j = 0; j < NumBones; ++j)
+        {
+            if (!cell || cell[j] != (int)target.rots[j])
+            {
+                cerr << path << " doesn't match at " << target.initialPos.x << ", " << target.initialPos.z << endl;
+                return false;
+            }
+        }
+    }
+
+    cout << "wrote " << path << ", mapped back in " << openSecs * 1e6 << "us" << endl;
+    return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+
+// writes gTargets as a header to path. returns the number of bytes the table needs on the robot, or 0 if it couldn't
+// be written
+size_t writeTableHeader(const string& path, TableEncoding encoding, bool halfTable)
+{
+    TableCells cells = collectTableCells(halfTable);
+    EncodedTable table;
+    if (!encodeTable(cells, encoding, table))
+    {
+        cerr << "table doesn't fit the " << tableEncodingName(encoding) << " encoding, writing it raw" << endl;
+        encodeTable(cells, TableEncoding::Raw, table);
+    }
+    if (!verifyEncodedTable(cells, table))
+        return 0;
+
+    ofstream ofs(path);
+    ofs << "// only two types of dances  x\n\n";
+
+    int minx = (int)TARGET_MIN_X / 10;
+    int maxx = (int)TARGET_MAX_X / 10;
+    int minz = (int)TARGET_MIN_Z / 10;
+    int maxz = (int)TARGET_MAX_Z / 10;
+
+    ofs << "namespace robo {\n";
+    ofs << "static const int MIN_X = " << minx << ";\n";
+    ofs << "static const int MAX_X = " << maxx << ";\n";
+    ofs << "static const int COUNT_X = " << (1 + maxx - minx) << ";\n";
+    ofs << "static const int MIN_Z = " << minz << ";\n";
+    ofs << "static const int MAX_Z = " << maxz << ";\n";
+    ofs << "static const int COUNT_Z = " << (1 + maxz - minz) << ";\n";
+    ofs << "static const int CELL_X_MM = " << TABLE_CELL_X_MM << ";\n";
+    ofs << "static const int CELL_Z_MM = " << TABLE_CELL_Z_MM << ";\n";
+    if (halfTable)
+        ofs << "static const int HALF_COUNT_X = " << (1 + maxx) << ";\n";
+    ofs << "static const int TABLE_COUNT_X = " << (halfTable ? "HALF_COUNT_X" : "COUNT_X") << ";\n";
+    ofs << "\n\n// target height is " << (int)TARGET_Y << "mm from bottom of bokksu\n\n";
+
+    if (table.encoding == TableEncoding::Raw)
+    {
+        ofs << "// rotTable is a 2D array of 4 rotations: [BASE_ROT, SHOULDER, ELBOW, WRIST], representing positions in a 2D grid spaced 1cm apart\n";
+        if (!halfTable)
+        {
+            ofs << "// The first element is at (MIN_X,MIN_Z), the fourth at (MIN_X+1,MIN_Z), and so on\n";
+        }
+        else
+        {
+            ofs << "// The arm is symmetric about x=0, so only x >= 0 is stored: the first element is at (0,MIN_Z), the fourth at (1,MIN_Z), and so on.\n";
+            ofs << "// Use lookup() to read it, which mirrors the table for x < 0\n";
+        }
+
+        ofs << "static const char rotTable[TABLE_COUNT_X * COUNT_Z * 4] PROGMEM = {\n";
+        for (const auto& target : gTargets)
+        {
+            if (halfTable && target.initialPos.x < 0.f)
+                continue;
+
+            ofs << "  " << target.rots[0] << ", " << target.rots[1] << ", " << target.rots[2] << ", " << target.rots[3] << ", ";
+            ofs << "  // " << (((int)target.initialPos.x)/10) << "cm , " << (((int)target.initialPos.z)/10) << "cm";
+            if (target.status == TargetStatus::Unreachable)
+                ofs << "  UNREACHABLE";
+            else if (target.status == TargetStatus::GaveUp)
+                ofs << "  NOT FOUND";
+            ofs << "\n";
+        }
+        ofs << "};\n\n";
+    }
+    else
+    {
+        ofs << "// the table holds 4 rotations per cell: [BASE_ROT, SHOULDER, ELBOW, WRIST], for positions in a 2D grid spaced 1cm apart.\n";
+        ofs << "// It's " << tableEncodingName(table.encoding) << " encoded, use lookup() to read it\n";
+    }
+
+    writeTableDecoder(ofs, table);
+
+    ofs << "// fills out with the 4 rotations for the grid point (x,z), in cm\n";
+    ofs << "static inline void lookup(int x, int z, char out[4])\n";
+    ofs << "{\n";
+    if (halfTable)
+    {
+        ofs << "  // mirroring only flips the base rotation\n";
+        ofs << "  char baseSign = (x < 0) ? -1 : 1;\n";
+        ofs << "  decodeCell(x * baseSign, z - MIN_Z, out);\n";
+        ofs << "  out[0] *= baseSign;\n";
+    }
+    else
+    {
+        ofs << "  decodeCell(x - MIN_X, z - MIN_Z, out);\n";
+    }
+    ofs << "}\n\n";
+
+    ofs << "// blends the 4 grid points around (xMm,zMm), in mm, using integer maths only. points off the grid are clamped to its edge\n";
+    ofs << "static inline void lookupMm(int xMm, int zMm, char out[4])\n";
+    ofs << "{\n";
+    ofs << "  int ox = xMm - MIN_X * 10;\n";
+    ofs << "  int oz = zMm - MIN_Z * 10;\n";
+    ofs << "  ox = (ox < 0) ? 0 : (ox > (COUNT_X - 1) * CELL_X_MM) ? (COUNT_X - 1) * CELL_X_MM : ox;\n";
+    ofs << "  oz = (oz < 0) ? 0 : (oz > (COUNT_Z - 1) * CELL_Z_MM) ? (COUNT_Z - 1) * CELL_Z_MM : oz;\n";
+    ofs << "  int ix = ox / CELL_X_MM;\n";
+    ofs << "  int iz = oz / CELL_Z_MM;\n";
+    ofs << "  int fx = ox - ix * CELL_X_MM;\n";
+    ofs << "  int fz = oz - iz * CELL_Z_MM;\n";
+    ofs << "  if (ix == COUNT_X - 1) { --ix; fx = CELL_X_MM; }\n";
+    ofs << "  if (iz == COUNT_Z - 1) { --iz; fz = CELL_Z_MM; }\n";
+    ofs << "\n";
+    ofs << "  char c00[4], c10[4], c01[4], c11[4];\n";
+    ofs << "  lookup(MIN_X + ix, MIN_Z + iz, c00);\n";
+    ofs << "  lookup(MIN_X + ix + 1, MIN_Z + iz, c10);\n";
+    ofs << "  lookup(MIN_X + ix, MIN_Z + iz + 1, c01);\n";
+    ofs << "  lookup(MIN_X + ix + 1, MIN_Z + iz + 1, c11);\n";
+    ofs << "\n";
+    ofs << "  // weights are in hundredths of a cell, so the sums fit in 16 bits\n";
+    ofs << "  int w00 = (CELL_X_MM - fx) * (CELL_Z_MM - fz);\n";
+    ofs << "  int w10 = fx * (CELL_Z_MM - fz);\n";
+    ofs << "  int w01 = (CELL_X_MM - fx) * fz;\n";
+    ofs << "  int w11 = fx * fz;\n";
+    ofs << "  const int cellArea = CELL_X_MM * CELL_Z_MM;\n";
+    ofs << "  for (int j = 0; j < 4; ++j)\n";
+    ofs << "  {\n";
+    ofs << "    int sum = w00 * c00[j] + w10 * c10[j] + w01 * c01[j] + w11 * c11[j];\n";
+    ofs << "    out[j] = (char)((sum + (sum < 0 ? -cellArea / 2 : cellArea / 2)) / cellArea);\n";
+    ofs << "  }\n";
+    ofs << "}\n\n";
 
     ofs << "} // namespace robo\n";
+
+    ofs.close();
+    if (!ofs)
+    {
+        cerr << "couldn't write " << path << endl;
+        return 0;
+    }
+    return table.bytes.size();
+}
+
+// returns the number of bytes the table needs on the robot, or 0 if it couldn't be written
+size_t writeResults()
+{
+    reportTableEncodings(collectTableCells(gOptions.halfTable));
+
+    size_t tableBytes = writeTableHeader("roboboogie.h", gOptions.encoding, gOptions.halfTable);
+    if (tableBytes == 0)
+        return 0;
+    if (gOptions.binaryTable && !writeBinaryTable("roboboogie.bin"))
+        return 0;
+    return tableBytes;
+}
+
+// one step of the windowed solve. targets go in row-major order, which has every cell's left and lower neighbours
+// solved before it, so each one is seeded just as solveTargetsParallel() would for --order and the window ends up with
+// the same table as --headless. gTargets is laid out up front so render() can read the ones that are done while this
+// runs. returns false once every target is done with
+bool stepSolver()
+{
+    if (gFoundAllTargets)
+        return false;
+
+    TargetPoint& target = gTargets[gCurrentTarget];
+    if (target.iterations == 0)
+    {
+        GridShape shape = targetGridShape();
+        if (gOptions.order == SolveOrder::Wavefront)
+            target.rots = neighbourSeed(gTargets, shape, (int)gCurrentTarget);
+        else
+            target.rots = gCurrentTarget % shape.countX == 0 ? REST_ROTATIONS : gRotations;
+        if (gOptions.verbose)
+            cout << "Starting " << target.pos.x << ", " << target.pos.y << ", " << target.pos.z << endl;
+    }
+
+    bool done = tickIK(target);
+    if (!done)
+        gRotations = target.rots;
+
+    ViewSnapshot& view = gViewSnapshots.writeSlot();
+    view.rots = gRotations;
+    view.status = target.status;
+    view.numDone = (int)gCurrentTarget + (done ? 1 : 0);
+    view.numSteps = ++gNumSolverSteps;
+    gViewSnapshots.publish();
+
+    if (done && ++gCurrentTarget == gTargets.size())
+        gFoundAllTargets = true;
+    return true;
+}
+
+// runs as many solver steps as fit in the frame budget, so the window shows how the solve is getting on rather than
+// setting its pace. it always takes at least one, so a budget of 0 is the old one step a frame
+void update(float deltaTime)
+{
+    auto budgetEnd = chrono::high_resolution_clock::now()
+        + chrono::duration_cast<chrono::high_resolution_clock::duration>(chrono::duration<float, milli>(gOptions.frameBudgetMs));
+
+    bool solving = stepSolver();
+    while (solving && chrono::high_resolution_clock::now() < budgetEnd)
+        solving = stepSolver();
+
+    if (!solving && !gWrittenResults)
+    {
+        size_t tableBytes = writeResults();
+        if (tableBytes > 0)
+            cout << "\n\n\n-------------------------\n" << tableBytes << "bytes needed for table" << endl;
+        else
+            cerr << "couldn't write the results" << endl;
+        gWrittenResults = true;
+        gWriteFailed = tableBytes == 0;
+    }
+}
+
+// shows how far the solve has got in the title bar, a couple of times a second
+void updateWindowTitle(const ViewSnapshot& view)
+{
+    static double lastTime = 0.0;
+    static int64_t lastSteps = 0;
+    bool done = view.numDone == (int)gTargets.size();
+    if (!done && gWallTime - lastTime < 0.5)
+        return;
+
+    char title[128];
+    if (done)
+        snprintf(title, sizeof(title), "grippr - done");
+    else
+        snprintf(title, sizeof(title), "grippr - %d of %d targets, %.0f steps/sec", view.numDone, (int)gTargets.size(),
+            (view.numSteps - lastSteps) / (gWallTime - lastTime));
+    SDL_SetWindowTitle(gWindow, title);
+
+    lastTime = gWallTime;
+    lastSteps = view.numSteps;
+}
+
+// by default the solve runs flat out on its own thread, with the window just showing the snapshots it publishes
+atomic<bool> gStopSolver = false;
+
+void solverThreadMain()
+{
+    while (!gStopSolver.load(memory_order_relaxed) && stepSolver())
+        ;
+
+    // update() writes the results once there's nothing left to solve, same as everywhere else
+    if (gFoundAllTargets)
+        update(0.f);
+}
+
+
+
+
+
+bool initGL()
+{
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_COLOR_MATERIAL);
+    glShadeModel(GL_FLAT);
+
+    glClearColor(0.9f, 0.45f, 0.2f, 1.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0f, (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 2.f, 2000.0f);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    float lightDir[] = { -0.7f, 0.3f, 0.5f, 0.f };
+    glLightfv(GL_LIGHT0, GL_POSITION, lightDir);
+    glEnable(GL_LIGHT0);
+
+    gQuadric = gluNewQuadric();
+    if (!gQuadric)
+    {
+        cerr << "couldn't allocate quadric" << endl;
+        return false;
+    }
+
+    float ambientLevel[] = { 0.3f, 0.3f, 0.3f, 1.f };
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambientLevel);
+
+    cout << "gl: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << endl;
+    if (!gOptions.legacyRender)
+    {
+        gUseRetainedRenderer = gRetainedRenderer.init();
+        if (!gUseRetainedRenderer)
+            cerr << "falling back to immediate-mode rendering" << endl;
+    }
+  
+    return true;
+}
+
+bool init()
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        cerr << "SDL could not initialize! SDL Error: " << SDL_GetError() << endl;
+        return false;
+    }
+
+    int screenWidth = SCREEN_WIDTH;
+    int screenHeight = SCREEN_HEIGHT;
+
+    float defaultDpi = 96.f;
+    float dpi = defaultDpi;
+    if (SDL_GetDisplayDPI(0, nullptr, &dpi, nullptr))
+    {
+        cerr << "Failed to read screen dpi: " << SDL_GetError() << endl;
+    }
+    float dpiRatio = dpi / defaultDpi;
+    screenWidth = (int)(dpiRatio * screenWidth);
+    screenHeight = (int)(dpiRatio * screenHeight);
+
+    //Create window
+    gWindow = SDL_CreateWindow("grippr",
+        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+        screenWidth, screenHeight,
+        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
+    if (!gWindow)
+    {
+        cerr << "Window could not be created! SDL Error: " << SDL_GetError() << endl;
+        return false;
+    }
+
+    //Use OpenGL 2.1
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+
+    //Create context
+    gContext = SDL_GL_CreateContext(gWindow);
+    if (gContext == NULL)
+    {
+        cerr << "OpenGL context could not be created! SDL Error: " << SDL_GetError() << endl;
+        return false;
+    }
+
+    if (SDL_GL_SetSwapInterval(gOptions.vsync ? 1 : 0) && gOptions.vsync)
+    {
+        cerr << "Failed to get vsync: " << SDL_GetError() << endl;
+    }
+
+    return initGL();
+}
+
+
+// draws numTargets markers spread over the floor, plus the arm, with each renderer we can run and reports how long a
+// frame takes. it runs in the window, or with --offscreen on whatever EGL gives us, which is llvmpipe without a GPU
+int runRenderBench(int numTargets)
+{
+    static const int warmupFrames = 3;
+    static const int timedFrames = 30;
+
+    int side = (int)ceil(sqrt((double)numTargets));
+    gTargets.clear();
+    for (int i = 0; i < numTargets; ++i)
+    {
+        TargetPoint& target = gTargets.emplace_back();
+        target.status = TargetStatus::Found;
+        target.pos = target.initialPos = vec3(-250.f + 500.f * (i % side) / side, TARGET_Y, -250.f + 500.f * (i / side) / side);
+    }
+    ViewSnapshot& view = gViewSnapshots.writeSlot();
+    view.numDone = numTargets;
+    gViewSnapshots.publish();
+
+    bool haveRetained = gUseRetainedRenderer;
+    for (bool retained : { false, true })
+    {
+        if (retained && !haveRetained)
+            continue;
+        gUseRetainedRenderer = retained;
+
+        for (int frame = 0; frame < warmupFrames; ++frame)
+            render(gViewSnapshots.read());
+        glFinish();
+
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int frame = 0; frame < timedFrames; ++frame)
+        {
+            render(gViewSnapshots.read());
+            glFinish();
+        }
+        double frameSecs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count() / timedFrames;
+        cout << (retained ? "retained" : "immediate") << ": " << numTargets << " targets, " << frameSecs * 1000.0
+            << "ms/frame" << endl;
+    }
+    gUseRetainedRenderer = haveRetained;
+
+    return glGetError() == GL_NO_ERROR ? 0 : 1;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// offscreen rendering, for machines without a display. an EGL context with no surface at all renders render()'s scene
+// into a framebuffer object, which we read back and write out as PPM images. the mesa drivers give us llvmpipe when
+// there's no GPU, so this works on a plain CPU box
+
+// a binary PPM, which anything can read and is trivial to write. rows run top to bottom
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    vector<uint8_t> rgb;
+};
+
+bool writePpm(const string& path, const Image& image)
+{
+    ofstream ofs(path, ios::binary);
+    ofs << "P6\n" << image.width << " " << image.height << "\n255\n";
+    ofs.write((const char*)image.rgb.data(), image.rgb.size());
+    if (!ofs)
+    {
+        cerr << "couldn't write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool readPpm(const string& path, Image& image)
+{
+    ifstream ifs(path, ios::binary);
+    string magic;
+    int maxValue = 0;
+    ifs >> magic >> image.width >> image.height >> maxValue;
+    ifs.get();
+    if (!ifs || magic != "P6" || maxValue != 255 || image.width <= 0 || image.height <= 0)
+    {
+        cerr << "couldn't read " << path << ", it needs to be a binary 8-bit PPM" << endl;
+        return false;
+    }
+    image.rgb.resize((size_t)image.width * image.height * 3);
+    ifs.read((char*)image.rgb.data(), image.rgb.size());
+    if (!ifs)
+    {
+        cerr << path << " is truncated" << endl;
+        return false;
+    }
+    return true;
+}
+
+// reads back what's been drawn, flipping it the right way up
+void captureFrame(Image& image)
+{
+    image.width = SCREEN_WIDTH;
+    image.height = SCREEN_HEIGHT;
+    image.rgb.resize((size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 3);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    size_t rowBytes = (size_t)SCREEN_WIDTH * 3;
+    for (int y = 0; y < SCREEN_HEIGHT; ++y)
+        glReadPixels(0, SCREEN_HEIGHT - 1 - y, SCREEN_WIDTH, 1, GL_RGB, GL_UNSIGNED_BYTE, image.rgb.data() + y * rowBytes);
+}
+
+// different GL implementations never quite agree on edges and shading, so a pixel only counts as different if a channel
+// is off by more than levels, and the check only fails if more than percent of the pixels are. a diff image showing
+// which ones goes next to the frame, to see what's moved
+bool compareWithGolden(const Image& frame, const string& goldenPath, int levels, float percent, const string& diffPath)
+{
+    Image golden;
+    if (!readPpm(goldenPath, golden))
+        return false;
+    if (golden.width != frame.width || golden.height != frame.height)
+    {
+        cerr << "golden image " << goldenPath << " is " << golden.width << "x" << golden.height << ", the frame is "
+            << frame.width << "x" << frame.height << endl;
+        return false;
+    }
+
+    Image diff = frame;
+    size_t numDifferent = 0;
+    int worst = 0;
+    for (size_t pixel = 0; pixel < frame.rgb.size(); pixel += 3)
+    {
+        int delta = 0;
+        for (int channel = 0; channel < 3; ++channel)
+            delta = max(delta, abs(frame.rgb[pixel + channel] - golden.rgb[pixel + channel]));
+        worst = max(worst, delta);
+
+        // different pixels in red over a faded copy of the frame
+        bool different = delta > levels;
+        numDifferent += different ? 1 : 0;
+        for (int channel = 0; channel < 3; ++channel)
+            diff.rgb[pixel + channel] = different ? (channel == 0 ? 255 : 0) : (uint8_t)(128 + frame.rgb[pixel + channel] / 2);
+    }
+
+    size_t numPixels = (size_t)frame.width * frame.height;
+    double differentPercent = 100.0 * numDifferent / numPixels;
+    bool passed = differentPercent <= percent;
+    cout << "golden " << goldenPath << ": " << numDifferent << " of " << numPixels << " pixels (" << differentPercent
+        << "%) off by more than " << levels << ", worst " << worst << ", " << (passed ? "passed" : "FAILED") << endl;
+    if (!passed)
+        writePpm(diffPath, diff);
+    return passed;
+}
+
+#if GRIPPR_EGL
+
+class OffscreenContext
+{
+public:
+    ~OffscreenContext()
+    {
+        if (mDisplay != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (mContext != EGL_NO_CONTEXT)
+                eglDestroyContext(mDisplay, mContext);
+            eglTerminate(mDisplay);
+        }
+    }
+
+    // makes a GL 2.1 compatible context current, drawing into a framebuffer object the size of the window
+    bool init()
+    {
+        // the surfaceless platform doesn't need a display server, if we can ask for it
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (mDisplay == EGL_NO_DISPLAY)
+            mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major = 0;
+        EGLint minor = 0;
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, &major, &minor))
+        {
+            cerr << "couldn't initialise EGL: 0x" << hex << eglGetError() << dec << endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            cerr << "this EGL can't do desktop OpenGL" << endl;
+            return false;
+        }
+
+        // no surface means no config either
+        EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, 2, EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE };
+        mContext = eglCreateContext(mDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+        if (mContext == EGL_NO_CONTEXT || !eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext))
+        {
+            cerr << "couldn't make a surfaceless GL context: 0x" << hex << eglGetError() << dec << endl;
+            return false;
+        }
+
+        auto genFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)eglGetProcAddress("glGenFramebuffers");
+        auto bindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)eglGetProcAddress("glBindFramebuffer");
+        auto genRenderbuffers = (PFNGLGENRENDERBUFFERSPROC)eglGetProcAddress("glGenRenderbuffers");
+        auto bindRenderbuffer = (PFNGLBINDRENDERBUFFERPROC)eglGetProcAddress("glBindRenderbuffer");
+        auto renderbufferStorage = (PFNGLRENDERBUFFERSTORAGEPROC)eglGetProcAddress("glRenderbufferStorage");
+        auto framebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)eglGetProcAddress("glFramebufferRenderbuffer");
+        auto checkFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)eglGetProcAddress("glCheckFramebufferStatus");
+        if (!genFramebuffers || !bindFramebuffer || !genRenderbuffers || !bindRenderbuffer || !renderbufferStorage
+            || !framebufferRenderbuffer || !checkFramebufferStatus)
+        {
+            cerr << "offscreen rendering needs framebuffer objects" << endl;
+            return false;
+        }
+
+        GLuint framebuffer;
+        GLuint renderbuffers[2];
+        genFramebuffers(1, &framebuffer);
+        bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        genRenderbuffers(2, renderbuffers);
+        bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCREEN_WIDTH, SCREEN_HEIGHT);
+        framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        bindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCREEN_WIDTH, SCREEN_HEIGHT);
+        framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            cerr << "offscreen framebuffer isn't complete" << endl;
+            return false;
+        }
+
+        glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        return true;
+    }
+
+private:
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLContext mContext = EGL_NO_CONTEXT;
+};
+
+#endif
+
+// replays the windowed solve without a window, a fixed number of solver steps per frame so the frames come out the
+// same every time, writing every captureEvery'th frame and the final one to dir. the final frame can then be checked
+// against a golden image
+int runOffscreen()
+{
+#if GRIPPR_EGL
+    OffscreenContext context;
+    gGetGlProcAddress = [](const char* name) { return (void*)eglGetProcAddress(name); };
+    if (!context.init() || !initGL())
+        return 1;
+
+    if (gOptions.renderBenchTargets > 0)
+        return runRenderBench(gOptions.renderBenchTargets);
+
+    error_code error;
+    filesystem::create_directories(gOptions.offscreenDir, error);
+    auto framePath = [](const char* name) { return (filesystem::path(gOptions.offscreenDir) / name).string(); };
+
+    gTargets = makeTargetGrid();
+    Image frame;
+    int numFrames = 0;
+    int numWritten = 0;
+    auto startTime = chrono::high_resolution_clock::now();
+    for (bool solving = true; solving; ++numFrames)
+    {
+        for (int step = 0; step < gOptions.offscreenStepsPerFrame && solving; ++step)
+            solving = stepSolver();
+        render(gViewSnapshots.read());
+
+        if (gOptions.offscreenCaptureEvery > 0 && numFrames % gOptions.offscreenCaptureEvery == 0)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "frame%05d.ppm", numFrames);
+            captureFrame(frame);
+            if (!writePpm(framePath(name), frame))
+                return 1;
+            ++numWritten;
+        }
+    }
+
+    // the results get written the same way as everywhere else
+    update(0.f);
+    render(gViewSnapshots.read());
+    captureFrame(frame);
+    if (!writePpm(framePath("final.ppm"), frame))
+        return 1;
+    double secs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    static const double playbackFps = 60.0;
+    cout << "offscreen: " << numFrames << " frames (" << numWritten << " written) in " << secs << "s, "
+        << numFrames / secs << " frames/sec, " << numFrames / playbackFps / secs << "x real time at " << playbackFps << "fps" << endl;
+
+    if (glGetError() != GL_NO_ERROR)
+    {
+        cerr << "GL error while rendering offscreen" << endl;
+        return 1;
+    }
+    if (!gOptions.goldenPath.empty()
+        && !compareWithGolden(frame, gOptions.goldenPath, gOptions.goldenLevels, gOptions.goldenPercent, framePath("diff.ppm")))
+        return 1;
+    return (gWrittenResults && !gWriteFailed) ? 0 : 1;
+#else
+    cerr << "offscreen rendering needs EGL, which this build doesn't have" << endl;
+    return 1;
+#endif
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+
+// random poses covering the whole range the joints can take, the same every run
+vector<BoneArray> makeBenchPoses(size_t count)
+{
+    mt19937 rng(1234);
+    uniform_real_distribution<float> angle(-180.f, 180.f);
+
+    vector<BoneArray> poses(count);
+    for (auto& pose : poses)
+        for (float& rot : pose)
+            rot = angle(rng);
+    return poses;
+}
+
+// times fn over every pose, several times over, returning nanoseconds per call
+template<typename Fn>
+double benchPerCall(const vector<BoneArray>& poses, int repeats, Fn&& fn)
+{
+    vec3 sink(0.f);
+    auto startTime = chrono::high_resolution_clock::now();
+    for (int repeat = 0; repeat < repeats; ++repeat)
+        for (const auto& pose : poses)
+            sink += fn(pose);
+    auto endTime = chrono::high_resolution_clock::now();
+
+    // make sure the work can't be optimised away
+    if (sink.x == 12345.f)
+        cout << " ";
+
+    return chrono::duration<double, nano>(endTime - startTime).count() / ((double)repeats * poses.size());
+}
+
+bool benchForwardKinematics()
+{
+    static const float tolerance = 0.01f;
+
+    vector<BoneArray> poses = makeBenchPoses(100'000);
+
+    float maxError = 0.f;
+    for (const auto& pose : poses)
+        maxError = max(maxError, glm::distance(calcHandPointReference(pose), calcHandPoint(pose)));
+    bool ok = maxError <= tolerance;
+    cout << "fk: planar kernel vs matrix chain max error " << maxError << "mm over " << poses.size() << " poses "
+        << (ok ? "(ok)" : "(FAILED)") << endl;
+
+    double referenceNs = benchPerCall(poses, 10, [](const BoneArray& pose) { return calcHandPointReference(pose); });
+    double planarNs = benchPerCall(poses, 10, [](const BoneArray& pose) { return calcHandPoint(pose); });
+    cout << "fk: matrix chain " << referenceNs << "ns, planar kernel " << planarNs << "ns ("
+        << referenceNs / planarNs << "x)" << endl;
+
+    return ok;
+}
+
+bool benchBatchedForwardKinematics()
+{
+    static const float tolerance = 0.01f;
+    static const int batchSize = 256;
+    static const int repeats = 20;
+
+    vector<BoneArray> poses = makeBenchPoses(batchSize * 400);
+    vector<PoseBatch<batchSize>> batches(poses.size() / batchSize);
+    vector<WholePoseBatch<batchSize>> wholeBatches(poses.size() / batchSize);
+    vector<BoneArray> wholePoses(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        batches[i / batchSize].add(poses[i]);
+
+        WholeBoneArray wholePose;
+        for (int bone = 0; bone < NumBones; ++bone)
+        {
+            wholePose[bone] = (int)roundf(poses[i][bone]);
+            wholePoses[i][bone] = (float)wholePose[bone];
+        }
+        wholeBatches[i / batchSize].add(wholePose);
+    }
+
+    // time every batch a few times over, returning nanoseconds per pose
+    auto timeBatches = [&](auto& allBatches)
+    {
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int repeat = 0; repeat < repeats; ++repeat)
+            for (auto& batch : allBatches)
+                calcHandPoints(batch);
+        auto endTime = chrono::high_resolution_clock::now();
+        return chrono::duration<double, nano>(endTime - startTime).count() / ((double)repeats * poses.size());
+    };
+
+    // the largest distance between each batch's answers and the matrix chain's
+    auto checkBatches = [&](auto& allBatches, const vector<BoneArray>& expectedPoses)
+    {
+        float maxError = 0.f;
+        for (size_t i = 0; i < expectedPoses.size(); ++i)
+        {
+            auto& batch = allBatches[i / batchSize];
+            if (i % batchSize == 0)
+                calcHandPoints(batch);
+            maxError = max(maxError, glm::distance(calcHandPointReference(expectedPoses[i]), batch.pos((int)(i % batchSize))));
+        }
+        return maxError;
+    };
+
+    bool ok = true;
+    FkKernels oldKernels = gFkKernels;
+    for (SimdLevel requested : { SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512 })
+    {
+        SimdLevel level;
+        gFkKernels = selectFkKernels(requested, &level);
+        if (level != requested)
+        {
+            cout << "batch fk: " << simdLevelName(requested) << " not supported here" << endl;
+            continue;
+        }
+
+        float maxError = checkBatches(batches, poses);
+        float maxWholeError = checkBatches(wholeBatches, wholePoses);
+        bool levelOk = maxError <= tolerance && maxWholeError <= tolerance;
+        ok &= levelOk;
+
+        double ns = timeBatches(batches);
+        double wholeNs = timeBatches(wholeBatches);
+
+        cout << "batch fk: " << simdLevelName(level) << " " << ns << "ns/pose (max error " << maxError << "mm), whole degrees "
+            << wholeNs << "ns/pose (max error " << maxWholeError << "mm) " << (levelOk ? "(ok)" : "(FAILED)") << endl;
+    }
+    gFkKernels = oldKernels;
+
+    return ok;
+}
+
+// calls fn with each of the 4^4 poses in the original fixed refinement window
+template<typename Angle, typename Fn>
+void forEachClassicRefinementPose(const TargetPoint& target, Fn&& fn)
+{
+    // the same servo range rule as refineToWholeAngles(), so they're comparable
+    auto candidate = [&](int bone, int guess, Angle& rot)
+    {
+        rot = (Angle)(floorf(target.rots[bone]) - 1.f + guess);
+        return isRefinementCandidate(bone, target.rots[bone], (int)rot);
+    };
+
+    array<Angle, NumBones> currRots;
+    for (int base = 0; base < numRefinementGuesses; ++base)
+    {
+        if (!candidate(BASE_ROT, base, currRots[BASE_ROT]))
+            continue;
+        for (int shoulder = 0; shoulder < numRefinementGuesses; ++shoulder)
+        {
+            if (!candidate(SHOULDER, shoulder, currRots[SHOULDER]))
+                continue;
+            for (int elbow = 0; elbow < numRefinementGuesses; ++elbow)
+            {
+                if (!candidate(ELBOW, elbow, currRots[ELBOW]))
+                    continue;
+                for (int wrist = 0; wrist < numRefinementGuesses; ++wrist)
+                {
+                    if (candidate(WRIST, wrist, currRots[WRIST]))
+                        fn(currRots);
+                }
+            }
+        }
+    }
+}
+
+// the whole-angle refinement as it originally was: every candidate pose through the matrix chain
+void refineToWholeAnglesReference(TargetPoint& target)
+{
+    float bestDistSq = FLT_MAX;
+    BoneArray bestRots;
+    vec3 bestPos;
+    forEachClassicRefinementPose<float>(target, [&](const BoneArray& rots)
+    {
+        vec3 testPos = calcHandPointReference(rots);
+        float testDistSq = distance_sq(testPos, target.initialPos);
+        if (testDistSq < bestDistSq)
+        {
+            bestDistSq = testDistSq;
+            bestPos = testPos;
+            bestRots = rots;
+        }
+    });
+
+    target.pos = bestPos;
+    target.rots = bestRots;
+}
+
+// ...and with every candidate evaluated in full through the batch kernels, with trig on integer-valued floats or with
+// the whole-degree tables
+template<typename Angle>
+void refineToWholeAnglesBatched(TargetPoint& target)
+{
+    PoseBatch<numRefinementPoses, Angle> batch;
+    forEachClassicRefinementPose<Angle>(target, [&](const array<Angle, NumBones>& rots) { batch.add(rots); });
+    calcHandPoints(batch);
+
+    float bestDistSq = FLT_MAX;
+    int bestIndex = 0;
+    for (int i = 0; i < batch.count; ++i)
+    {
+        float testDistSq = distance_sq(batch.pos(i), target.initialPos);
+        if (testDistSq < bestDistSq)
+        {
+            bestDistSq = testDistSq;
+            bestIndex = i;
+        }
+    }
+
+    target.pos = batch.pos(bestIndex);
+    auto bestRots = batch.pose(bestIndex);
+    for (int bone = 0; bone < NumBones; ++bone)
+        target.rots[bone] = (float)bestRots[bone];
+}
+
+bool benchWholeAngleRefinement()
+{
+    static const float tolerance = 0.01f;
+    static const int repeats = 10;
+
+    // refine from a point near each random pose's hand, the way the solver hands over a converged pose
+    vector<BoneArray> poses = makeBenchPoses(10'000);
+    vector<TargetPoint> targets(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        targets[i].rots = poses[i];
+        targets[i].pos = targets[i].initialPos = calcHandPoint(poses[i]);
+    }
+
+    auto timeRefinement = [&](auto&& refine)
+    {
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            for (const auto& target : targets)
+            {
+                TargetPoint refined = target;
+                refine(refined);
+            }
+        }
+        auto endTime = chrono::high_resolution_clock::now();
+        return chrono::duration<double, nano>(endTime - startTime).count() / ((double)repeats * targets.size());
+    };
+
+    // how far each refinement's choice is from the original's, which checks every candidate exactly
+    auto maxDifferenceFromReference = [&](auto&& refine)
+    {
+        float maxDifference = 0.f;
+        for (const auto& target : targets)
+        {
+            TargetPoint reference = target;
+            TargetPoint refined = target;
+            refineToWholeAnglesReference(reference);
+            refine(refined);
+            maxDifference = max(maxDifference, fabsf(glm::distance(reference.pos, target.initialPos) - glm::distance(refined.pos, target.initialPos)));
+        }
+        return maxDifference;
+    };
+
+    int oldWindow = gOptions.refineWindow;
+    gOptions.refineWindow = 2;
+
+    float trigDifference = maxDifferenceFromReference(refineToWholeAnglesBatched<float>);
+    float tableDifference = maxDifferenceFromReference(refineToWholeAnglesBatched<int>);
+    float searchDifference = maxDifferenceFromReference(refineToWholeAngles);
+    bool ok = trigDifference <= tolerance && tableDifference <= tolerance && searchDifference <= tolerance;
+
+    double referenceNs = timeRefinement(refineToWholeAnglesReference);
+    double trigNs = timeRefinement(refineToWholeAnglesBatched<float>);
+    double tableNs = timeRefinement(refineToWholeAnglesBatched<int>);
+    cout << "refinement: matrix chain " << referenceNs / 1000.0 << "us, trig batch " << trigNs / 1000.0 << "us ("
+        << referenceNs / trigNs << "x), table batch " << tableNs / 1000.0 << "us (" << referenceNs / tableNs << "x)" << endl;
+
+    // the branch and bound search at the classic window and a few wider ones
+    for (int window : { 2, 3, 5 })
+    {
+        gOptions.refineWindow = window;
+
+        int64_t evaluations = 0;
+        int64_t pruned = 0;
+        float totalDist = 0.f;
+        for (const auto& target : targets)
+        {
+            TargetPoint refined = target;
+            refineToWholeAngles(refined);
+            evaluations += refined.refineEvaluations;
+            pruned += refined.refinePruned;
+            totalDist += glm::distance(refined.pos, target.initialPos);
+        }
+
+        double searchNs = timeRefinement(refineToWholeAngles);
+        cout << "refinement: branch and bound +-" << window << " " << searchNs / 1000.0 << "us (" << referenceNs / searchNs << "x), "
+            << (double)evaluations / targets.size() << " evaluated, " << (double)pruned / targets.size() << " pruned, mean error "
+            << totalDist / targets.size() << "mm" << endl;
+    }
+    gOptions.refineWindow = oldWindow;
+
+    cout << "refinement: max difference from matrix chain " << max(max(trigDifference, tableDifference), searchDifference) << "mm "
+        << (ok ? "(ok)" : "(FAILED)") << endl;
+
+    return ok;
+}
+
+bool benchGradientStep()
+{
+    static const float tolerance = 0.001f;
+    static const int repeats = 10;
+
+    // step towards a point a few mm from each random pose's hand, some close enough for the fine step size. the
+    // offsets stay clear of where it switches, where rounding could send the two different ways
+    vector<BoneArray> poses = makeBenchPoses(10'000);
+    vector<TargetPoint> targets(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        float offset = 0.5f + (float)(i % 8);
+        targets[i].rots = poses[i];
+        targets[i].pos = targets[i].initialPos = calcHandPoint(poses[i]) + vec3(offset, -offset, 0.5f * offset);
+    }
+
+    auto timeStep = [&](auto&& step)
+    {
+        auto startTime = chrono::high_resolution_clock::now();
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            for (const auto& target : targets)
+            {
+                TargetPoint stepped = target;
+                step(stepped);
+            }
+        }
+        auto endTime = chrono::high_resolution_clock::now();
+        return chrono::duration<double, nano>(endTime - startTime).count() / ((double)repeats * targets.size());
+    };
+
+    float maxDifference = 0.f;
+    for (const auto& target : targets)
+    {
+        TargetPoint prefix = target;
+        TargetPoint batched = target;
+        tickIKInternalPrefix(prefix);
+        tickIKInternalBatched(batched);
+        for (int bone = 0; bone < NumBones; ++bone)
+            maxDifference = max(maxDifference, fabsf(prefix.rots[bone] - batched.rots[bone]));
+    }
+    bool ok = maxDifference <= tolerance;
+
+    double prefixNs = timeStep(tickIKInternalPrefix);
+    cout << "gradient step: prefix cache " << prefixNs << "ns";
+    FkKernels oldKernels = gFkKernels;
+    for (SimdLevel requested : { SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512 })
+    {
+        SimdLevel level;
+        gFkKernels = selectFkKernels(requested, &level);
+        if (level != requested)
+            continue;
+        double batchedNs = timeStep(tickIKInternalBatched);
+        cout << ", " << simdLevelName(level) << " batch " << batchedNs << "ns (" << batchedNs / prefixNs << "x)";
+    }
+    gFkKernels = oldKernels;
+    cout << ", max difference " << maxDifference << " degrees " << (ok ? "(ok)" : "(FAILED)") << endl;
+
+    return ok;
+}
+
+// how much neighbour seeding saves the iterative solvers over the original row-major warm start
+bool benchSolveOrder()
+{
+    SolverType oldSolver = gOptions.solver;
+    for (SolverType solver : { SolverType::Gradient, SolverType::DampedLeastSquares })
+    {
+        gOptions.solver = solver;
+
+        int64_t iterations[2] = {};
+        int64_t fkEvaluations[2] = {};
+        for (SolveOrder order : { SolveOrder::RowMajor, SolveOrder::Wavefront })
+        {
+            vector<TargetPoint> targets = makeTargetGrid();
+            solveTargetsParallel(targets, targetGridShape(), 1, order);
+            for (const auto& target : targets)
+            {
+                iterations[(int)order] += target.iterations;
+                fkEvaluations[(int)order] += target.fkEvaluations;
+            }
+        }
+
+        const char* name = (solver == SolverType::Gradient) ? "gradient" : "dls";
+        cout << "solve order: " << name << " row-major " << iterations[0] << " iterations (" << fkEvaluations[0] << " fk), wavefront "
+            << iterations[1] << " iterations (" << fkEvaluations[1] << " fk), "
+            << 100.0 * (1.0 - (double)iterations[1] / iterations[0]) << "% fewer iterations" << endl;
+    }
+    gOptions.solver = oldSolver;
+
+    return true;
+}
+
+// the program benchGeneratedHeader() builds against each header: lookup() for every grid point, then lookupMm() for
+// every mm, a line of 4 rotations each
+static const char* HEADER_CHECK_SOURCE =
+    "#include <stdio.h>\n"
+    "#define PROGMEM\n"
+    "#define pgm_read_byte(p) (*(const unsigned char*)(p))\n"
+    "#include \"roboboogie.h\"\n"
+    "int main()\n"
+    "{\n"
+    "  char out[4];\n"
+    "  for (int z = robo::MIN_Z; z <= robo::MAX_Z; ++z)\n"
+    "    for (int x = robo::MIN_X; x <= robo::MAX_X; ++x)\n"
+    "    {\n"
+    "      robo::lookup(x, z, out);\n"
+    "      printf(\"%d %d %d %d\\n\", out[0], out[1], out[2], out[3]);\n"
+    "    }\n"
+    "  for (int z = robo::MIN_Z * 10; z <= robo::MAX_Z * 10; ++z)\n"
+    "    for (int x = robo::MIN_X * 10; x <= robo::MAX_X * 10; ++x)\n"
+    "    {\n"
+    "      robo::lookupMm(x, z, out);\n"
+    "      printf(\"%d %d %d %d\\n\", out[0], out[1], out[2], out[3]);\n"
+    "    }\n"
+    "  return 0;\n"
+    "}\n";
+
+// writes the header in every encoding, with and without --half-table, and once more with a jump in one row that the
+// delta encoding has to store raw. each one is compiled into a little program with the host compiler ($CXX, or c++)
+// and run, to check that what the robot would decode matches the table. skipped if there's no compiler to hand
+bool benchGeneratedHeader()
+{
+    const char* compiler = getenv("CXX");
+    if (!compiler || !*compiler)
+        compiler = "c++";
+
+    error_code error;
+    filesystem::path dir = filesystem::temp_directory_path(error) / "grippr-header-check";
+    filesystem::create_directories(dir, error);
+    {
+        ofstream ofs(dir / "check.cpp");
+        ofs << HEADER_CHECK_SOURCE;
+    }
+    string exePath = (dir / "check.exe").string();
+    auto compile = [&](const filesystem::path& source)
+    {
+        string command = string("\"") + compiler + "\" -O1 -o \"" + exePath + "\" \"" + source.string() + "\" > \""
+            + (dir / "compile.log").string() + "\" 2>&1";
+        return system(command.c_str()) == 0;
+    };
+
+    {
+        ofstream ofs(dir / "empty.cpp");
+        ofs << "int main() { return 0; }\n";
+    }
+    if (!compile(dir / "empty.cpp"))
+    {
+        cout << "generated header: couldn't run " << compiler << ", skipped" << endl;
+        return true;
+    }
+
+    vector<TargetPoint> oldTargets = move(gTargets);
+    gTargets = makeTargetGrid();
+    solveTargetsParallel(gTargets, targetGridShape(), 0, gOptions.order);
+
+    struct Case
+    {
+        TableEncoding encoding;
+        bool halfTable;
+        bool jump;
+    };
+    bool ok = true;
+    for (Case check : { Case{ TableEncoding::Raw, false, false }, Case{ TableEncoding::Raw, true, false },
+        Case{ TableEncoding::RowDelta, false, false }, Case{ TableEncoding::RowDelta, true, false },
+        Case{ TableEncoding::BitPack, false, false }, Case{ TableEncoding::BitPack, true, false },
+        Case{ TableEncoding::RowDelta, false, true } })
+    {
+        vector<TargetPoint> targets = gTargets;
+        if (check.jump)
+        {
+            TargetPoint& target = gTargets[gTargets.size() / 2];
+            target.rots[ELBOW] += (target.rots[ELBOW] > 0.f) ? -30.f : 30.f;
+        }
+
+        // what lookup() should give at every grid point, mirroring the x >= 0 half for --half-table
+        TableCells full = collectTableCells(false);
+        TableCells expected = full;
+        GridShape shape = targetGridShape();
+        for (int iz = 0; iz < shape.countZ; ++iz)
+        {
+            for (int ix = 0; ix < shape.countX; ++ix)
+            {
+                int x = (int)gTargets[ix].initialPos.x / 10;
+                if (!check.halfTable || x >= 0)
+                    continue;
+                int mirrorIx = ix - 2 * x;
+                WholeBoneArray& rots = expected.rots[(size_t)iz * shape.countX + ix];
+                rots = full.rots[(size_t)iz * shape.countX + mirrorIx];
+                rots[BASE_ROT] = -rots[BASE_ROT];
+            }
+        }
+
+        EncodedTable table;
+        encodeTable(collectTableCells(check.halfTable), check.encoding, table);
+        size_t tableBytes = writeTableHeader((dir / "roboboogie.h").string(), check.encoding, check.halfTable);
+        gTargets = move(targets);
+
+        cout << "generated header: " << tableEncodingName(check.encoding) << (check.halfTable ? " half" : " full")
+            << (check.jump ? " with a jump" : "") << ", " << tableBytes << " bytes";
+        if (check.jump)
+            cout << " (" << table.numRawRows << " row stored raw)";
+        if (tableBytes == 0 || !compile(dir / "check.cpp"))
+        {
+            cout << ", doesn't compile, see " << (dir / "compile.log").string() << " (FAILED)" << endl;
+            ok = false;
+            continue;
+        }
+        string command = "\"" + exePath + "\" > \"" + (dir / "check.txt").string() + "\"";
+        if (system(command.c_str()) != 0)
+        {
+            cout << ", didn't run (FAILED)" << endl;
+            ok = false;
+            continue;
+        }
+
+        // every grid point, then every mm, which the host's own interpolation has to match exactly
+        ifstream ifs(dir / "check.txt");
+        int numLookups = 0;
+        int numMismatches = 0;
+        auto checkLine = [&](const WholeBoneArray& wanted)
+        {
+            WholeBoneArray decoded;
+            for (int j = 0; j < NumBones; ++j)
+                ifs >> decoded[j];
+            numMismatches += (!ifs || decoded != wanted) ? 1 : 0;
+            ++numLookups;
+        };
+        for (const auto& rots : expected.rots)
+            checkLine(rots);
+        for (int zMm = (int)TARGET_MIN_Z / 10 * 10; zMm <= (int)TARGET_MAX_Z / 10 * 10; ++zMm)
+        {
+            for (int xMm = (int)TARGET_MIN_X / 10 * 10; xMm <= (int)TARGET_MAX_X / 10 * 10; ++xMm)
+            {
+                WholeBoneArray wanted;
+                interpolateTableMm(expected, xMm, zMm, wanted);
+                checkLine(wanted);
+            }
+        }
+
+        bool checked = numMismatches == 0 && (!check.jump || table.numRawRows == 1);
+        cout << ", " << numLookups - numMismatches << " of " << numLookups << " lookups match " << (checked ? "(ok)" : "(FAILED)") << endl;
+        ok &= checked;
+    }
+
+    gTargets = move(oldTargets);
+    return ok;
+}
+
+// micro benchmarks and equivalence checks for the solver's building blocks
+int runBenchmarks()
+{
+    bool ok = true;
+    ok &= benchForwardKinematics();
+    ok &= benchBatchedForwardKinematics();
+    ok &= benchWholeAngleRefinement();
+    ok &= benchGradientStep();
+    ok &= benchSolveOrder();
+    ok &= benchGeneratedHeader();
+    return ok ? 0 : 1;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// volume tables: the same grid at several heights, so we can lift the pen off and draw at more than one level. the
+// volume is solved and written a level at a time, so only one level of targets is ever in memory however big it gets
+
+// solves the volume a level at a time and streams each level out as soon as it's done
+bool generateVolume(float minY, float maxY, float stepY, TableWriter& writer, int numThreads)
+{
+    VolumeShape shape = { targetGridShape(), minY, stepY, 0 };
+    for (float y = minY; y <= maxY; y += stepY)
+        ++shape.countY;
+
+    double solveSecs = 0.0;
+    double writeSecs = 0.0;
+    auto timed = [](double& secs, auto&& fn)
+    {
+        auto startTime = chrono::high_resolution_clock::now();
+        bool ok = fn();
+        secs += chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+        return ok;
+    };
+
+    if (!timed(writeSecs, [&] { return writer.begin(shape); }))
+    {
+        cerr << "couldn't start writing the volume table" << endl;
+        return false;
+    }
+
+    vector<TargetPoint> level;
+    size_t numUnreachable = 0;
+    size_t numGaveUp = 0;
+    for (int iy = 0; iy < shape.countY; ++iy)
+    {
+        float y = minY + iy * stepY;
+        timed(solveSecs, [&]
+        {
+            level = makeTargetGrid(y);
+            solveTargetsParallel(level, shape.grid, numThreads, gOptions.order);
+            return true;
+        });
+        for (const auto& target : level)
+        {
+            numUnreachable += (target.status == TargetStatus::Unreachable) ? 1 : 0;
+            numGaveUp += (target.status == TargetStatus::GaveUp) ? 1 : 0;
+        }
+
+        if (!timed(writeSecs, [&] { return writer.writeLevel(y, level); }))
+        {
+            cerr << "couldn't write level y = " << y << "mm of the volume table" << endl;
+            return false;
+        }
+    }
+
+    if (!timed(writeSecs, [&] { return writer.end(); }))
+    {
+        cerr << "couldn't finish writing the volume table" << endl;
+        return false;
+    }
+
+    size_t numCells = (size_t)shape.countY * shape.grid.countX * shape.grid.countZ;
+    cout << "volume: " << shape.countY << " levels, " << numCells << " targets solved in " << solveSecs << "s ("
+        << numCells / solveSecs << " targets/sec), " << numUnreachable << " out of reach, " << numGaveUp << " not found" << endl;
+    cout << "volume writer: " << writer.bytesWritten() << " bytes in " << writeSecs * 1000.0 << "ms ("
+        << writer.bytesWritten() / writeSecs / (1024.0 * 1024.0) << " MB/s, " << numCells / writeSecs << " cells/sec), "
+        << level.size() * sizeof(TargetPoint) << " bytes of targets in memory" << endl;
+    return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// exhaustive whole-degree search. the table can only hold whole degrees, so the best possible entry for a cell is the
+// whole-degree pose that lands closest to it, and we can just try them all.
+//
+// the base decouples: with the arm reaching out R and up H in its own plane, the hand is at (-R sin b, H, R cos b), so
+// for R > 0 the base that gets closest is the whole degree nearest the target's bearing whatever the other joints
+// are. with that fixed at b, and the target's bearing t and distance r, the squared distance is
+//     (H - y)^2 + (R - r cos(b - t))^2 + (r sin(b - t))^2
+// so each cell is a point in the (R,H) plane, and we sweep every whole-degree shoulder, elbow and wrist through the
+// batched fk, binning the cells by R so each pose only looks at the cells it might be best for. they only sweep the
+// servo range: the full char range finds "better" poses with the arm folded back over itself, which isn't much use for
+// drawing
+
+struct ExhaustiveCell
+{
+    int base;
+    float planarR;          // r cos(b - t)
+    float planarY;
+    float offPlaneSq;       // (r sin(b - t))^2
+};
+
+struct ExhaustiveBest
+{
+    float distSq;
+    WholeBoneArray rots;
+
+    // ties go to the lexicographically smallest pose, so the result doesn't depend on how the sweep was split up
+    bool betterThan(const ExhaustiveBest& other) const
+    {
+        if (distSq != other.distSq)
+            return distSq < other.distSq;
+        return rots < other.rots;
+    }
+};
+
+// finds the best whole-degree pose inside the servo range for every target. what they have now only bounds the
+// search: it can't be the answer itself, since the solver may have left some of them out of range
+void solveTargetsExhaustive(vector<TargetPoint>& targets, int numThreads)
+{
+    vector<ExhaustiveCell> cells;
+    float bound = 0.f;
+    for (const auto& target : targets)
+    {
+        vec3 wanted = target.initialPos;
+        float r = sqrtf(wanted.x * wanted.x + wanted.z * wanted.z);
+        float bearing = atan2f(-wanted.x, wanted.z) * RADTODEG;
+        int base = (int)lroundf(bearing);
+        float offset = (base - bearing) * DEGTORAD;
+        cells.push_back({ base, r * cosf(offset), wanted.y, r * r * sinf(offset) * sinf(offset) });
+
+        // an in-range pose is a pose the sweep will get to, so the best it finds is at least this close. one that isn't
+        // says nothing about what's reachable in range, so then nothing can be ruled out
+        WholeBoneArray rots;
+        bool inServoRange = true;
+        for (int j = 0; j < NumBones; ++j)
+        {
+            rots[j] = (int)target.rots[j];
+            if (j != BASE_ROT)
+                inServoRange = inServoRange && rots[j] >= SERVO_MIN_DEGREES && rots[j] <= SERVO_MAX_DEGREES;
+        }
+        bound = inServoRange ? max(bound, distance(calcHandPointWhole(rots), wanted)) : numeric_limits<float>::max();
+    }
+
+    // nothing further than the worst current cell can improve on anything, so only poses that land within that of
+    // some cell in R, and of the target height, need looking at
+    float minR = numeric_limits<float>::max();
+    float maxR = numeric_limits<float>::lowest();
+    float minY = numeric_limits<float>::max();
+    float maxY = numeric_limits<float>::lowest();
+    for (const auto& cell : cells)
+    {
+        minR = min(minR, cell.planarR);
+        maxR = max(maxR, cell.planarR);
+        minY = min(minY, cell.planarY);
+        maxY = max(maxY, cell.planarY);
+    }
+    int numBins = (int)(maxR - minR) + 1;
+    vector<vector<int>> bins(numBins);
+    for (int cell = 0; cell < (int)cells.size(); ++cell)
+        bins[(int)(cells[cell].planarR - minR)].push_back(cell);
+
+    ExhaustiveBest noneYet = { numeric_limits<float>::infinity(), {} };
+    atomic<int> nextShoulder = SERVO_MIN_DEGREES;
+    vector<vector<ExhaustiveBest>> workerBest(numThreads, vector<ExhaustiveBest>(cells.size(), noneYet));
+    auto workerMain = [&](int worker)
+    {
+        vector<ExhaustiveBest>& best = workerBest[worker];
+        auto batch = make_unique<WholePoseBatch<1024>>();
+
+        auto scanBatch = [&]()
+        {
+            calcHandPoints(*batch);
+            for (int pose = 0; pose < batch->count; ++pose)
+            {
+                float reach = batch->z[pose];
+                float height = batch->y[pose];
+                if (height < minY - bound || height > maxY + bound || reach < minR - bound || reach > maxR + bound)
+                    continue;
+
+                int firstBin = (int)max(0.f, reach - bound - minR);
+                int lastBin = (int)min((float)(numBins - 1), reach + bound - minR);
+                for (int bin = firstBin; bin <= lastBin; ++bin)
+                {
+                    for (int cellIndex : bins[bin])
+                    {
+                        const ExhaustiveCell& cell = cells[cellIndex];
+                        float dr = reach - cell.planarR;
+                        float dy = height - cell.planarY;
+                        ExhaustiveBest candidate;
+                        candidate.distSq = dr * dr + dy * dy + cell.offPlaneSq;
+                        if (candidate.distSq > best[cellIndex].distSq)
+                            continue;
+
+                        candidate.rots = batch->pose(pose);
+                        candidate.rots[BASE_ROT] = cell.base;
+                        if (candidate.betterThan(best[cellIndex]))
+                            best[cellIndex] = candidate;
+                    }
+                }
+            }
+            batch->count = 0;
+        };
+
+        for (int shoulder = nextShoulder++; shoulder <= SERVO_MAX_DEGREES; shoulder = nextShoulder++)
+        {
+            for (int elbow = SERVO_MIN_DEGREES; elbow <= SERVO_MAX_DEGREES; ++elbow)
+            {
+                for (int wrist = SERVO_MIN_DEGREES; wrist <= SERVO_MAX_DEGREES; ++wrist)
+                {
+                    batch->add({ 0, shoulder, elbow, wrist });
+                    if (batch->count == 1024)
+                        scanBatch();
+                }
+            }
+        }
+        if (batch->count > 0)
+            scanBatch();
+    };
+
+    vector<thread> workers;
+    for (int worker = 1; worker < numThreads; ++worker)
+        workers.emplace_back(workerMain, worker);
+    workerMain(0);
+    for (auto& worker : workers)
+        worker.join();
+
+    for (int cell = 0; cell < (int)targets.size(); ++cell)
+    {
+        ExhaustiveBest best = noneYet;
+        for (const auto& results : workerBest)
+            if (results[cell].betterThan(best))
+                best = results[cell];
+
+        TargetPoint& target = targets[cell];
+        for (int j = 0; j < NumBones; ++j)
+            target.rots[j] = (float)best.rots[j];
+        target.pos = calcHandPointWhole(best.rots);
+    }
+}
+
+// runs the exhaustive search over gTargets, reporting how far the solver's table is from the best possible, and
+// optionally replacing it. the best poses for neighbouring cells can be quite different from each other, so the
+// replaced table is better cell by cell but worse to interpolate between
+void compareWithExhaustive(int numThreads, bool replace)
+{
+    vector<TargetPoint> optimal = gTargets;
+
+    auto startTime = chrono::high_resolution_clock::now();
+    solveTargetsExhaustive(optimal, numThreads);
+    double sweepSecs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    int numImproved = 0;
+    double totalSolverError = 0.0;
+    double totalOptimalError = 0.0;
+    float worstExcess = 0.f;
+    for (size_t cell = 0; cell < gTargets.size(); ++cell)
+    {
+        float solverError = length(gTargets[cell].pos - gTargets[cell].initialPos);
+        float optimalError = length(optimal[cell].pos - optimal[cell].initialPos);
+        totalSolverError += solverError;
+        totalOptimalError += optimalError;
+        worstExcess = max(worstExcess, solverError - optimalError);
+        if (solverError - optimalError > 0.001f)
+            ++numImproved;
+    }
+
+    int64_t servoSteps = SERVO_MAX_DEGREES - SERVO_MIN_DEGREES + 1;
+    int64_t numPoses = servoSteps * servoSteps * servoSteps;
+    cout << "exhaustive: " << numPoses << " poses in " << sweepSecs << "s (" << numPoses / sweepSecs / 1e6 << "M poses/sec)" << endl;
+    cout << "exhaustive: solver beaten on " << numImproved << " of " << gTargets.size() << " cells, mean error "
+        << totalSolverError / gTargets.size() << "mm -> " << totalOptimalError / gTargets.size() << "mm, worst excess "
+        << worstExcess << "mm" << endl;
+
+    if (replace)
+        gTargets = move(optimal);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------------
+// multi-start. gradient descent settles into whichever elbow or wrist branch its warm start leads it to, so a cell can
+// come out on a different branch from its neighbours, or not at all. solve every target again from a fixed spread of
+// seeds and keep whichever solution scores best under the chosen objective, the original one included
+
+static const int MAX_STARTS = 64;
+
+const char* startObjectiveName(StartObjective objective)
+{
+    switch (objective)
+    {
+    case StartObjective::Error: return "hand error (mm)";
+    case StartObjective::Rest: return "distance from rest (degrees)";
+    case StartObjective::Smooth: return "distance from neighbours (degrees)";
+    }
+    return "?";
+}
+
+// one coordinate of the index-th halton point, which fills [0,1) evenly however far along the sequence you stop
+float haltonSequence(int index, int base)
+{
+    float result = 0.f;
+    float fraction = 1.f / base;
+    for (; index > 0; index /= base)
+    {
+        result += fraction * (index % base);
+        fraction /= base;
+    }
+    return result;
 }
 
-void update(float deltaTime)
+// the start-th seed for a target, counting from 1. the base decouples, so it just faces the target, and the other
+// joints are a halton point over the servo range, so the seeds cover it evenly whatever --multi-start says
+BoneArray multiStartSeed(const TargetPoint& target, int start)
+{
+    static const int haltonBases[] = { 2, 3, 5 };
+
+    BoneArray seed;
+    seed[BASE_ROT] = atan2f(-target.initialPos.x, target.initialPos.z) * RADTODEG;
+    for (int j = SHOULDER; j < NumBones; ++j)
+    {
+        seed[j] = SERVO_MIN_DEGREES + (SERVO_MAX_DEGREES - SERVO_MIN_DEGREES) * haltonSequence(start, haltonBases[j - SHOULDER]);
+    }
+    return seed;
+}
+
+// lower is better. a solution that wasn't found, or needs the servos to go further than they can, is never picked
+float startScore(const TargetPoint& solution, StartObjective objective, const BoneArray& reference)
+{
+    if (solution.status != TargetStatus::Found)
+        return numeric_limits<float>::max();
+    for (float rot : solution.rots)
+    {
+        if (rot < SERVO_MIN_DEGREES || rot > SERVO_MAX_DEGREES)
+            return numeric_limits<float>::max();
+    }
+
+    if (objective == StartObjective::Error)
+        return length(solution.pos - solution.initialPos);
+
+    float distSq = 0.f;
+    for (int j = 0; j < NumBones; ++j)
+        distSq += (solution.ikRots[j] - reference[j]) * (solution.ikRots[j] - reference[j]);
+    return sqrtf(distSq);
+}
+
+// the mean IK solution of a cell's found neighbours in x and z, or its own if it hasn't got any
+BoneArray neighbourMean(const vector<TargetPoint>& targets, GridShape shape, int cell)
+{
+    int ix = cell % shape.countX;
+    int iz = cell / shape.countX;
+    BoneArray sum = {};
+    int count = 0;
+    for (auto [dx, dz] : { pair(-1, 0), pair(1, 0), pair(0, -1), pair(0, 1) })
+    {
+        int nx = ix + dx;
+        int nz = iz + dz;
+        if (nx < 0 || nx >= shape.countX || nz < 0 || nz >= shape.countZ)
+            continue;
+        const TargetPoint& neighbour = targets[nz * shape.countX + nx];
+        if (neighbour.status != TargetStatus::Found)
+            continue;
+        for (int j = 0; j < NumBones; ++j)
+            sum[j] += neighbour.ikRots[j];
+        ++count;
+    }
+
+    if (count == 0)
+        return targets[cell].ikRots;
+    for (float& rot : sum)
+        rot /= count;
+    return sum;
+}
+
+// re-solves every target from numStarts - 1 more seeds, sharing the (target, seed) pairs out between workers, then
+// keeps the best of them and the solution the target already had. ties go to the earlier start, so the result doesn't
+// depend on the scheduling, and a target only changes if a restart actually beat it
+void solveTargetsMultiStart(vector<TargetPoint>& targets, GridShape shape, int numStarts, StartObjective objective, int numThreads)
 {
-    if (!gFoundAllTargets || !gTargets.back().found)
+    static const float minImprovement = 0.001f;
+
+    int numRestarts = numStarts - 1;
+    vector<TargetPoint> solutions((size_t)targets.size() * numRestarts);
+
+    auto startTime = chrono::high_resolution_clock::now();
+    atomic<size_t> next = 0;
+    auto workerMain = [&]()
     {
-        if (gTargets.empty() || gTargets.back().found)
+        for (size_t task = next++; task < solutions.size(); task = next++)
         {
-            TargetPoint& target = gTargets.emplace_back();
-            target.found = false;
-            copy(gRotations.begin(), gRotations.end(), target.rots.begin());
-            target.pos = target.initialPos = vec3(gNextTargetX, TARGET_Y, gNextTargetZ);
-            cout << "Starting " << target.pos.x << ", " << target.pos.y << ", " << target.pos.z << endl;
+            const TargetPoint& original = targets[task / numRestarts];
+            TargetPoint& solution = solutions[task];
+            solution.initialPos = original.initialPos;
+            solution.pos = original.initialPos;
 
-            gNextTargetX += TARGET_STEP_X;
-            if (gNextTargetX > TARGET_MAX_X)
+            // the workspace map already ruled these out, no seed is going to do better
+            if (original.status == TargetStatus::Unreachable)
             {
-                gNextTargetX = TARGET_MIN_X;
-                gNextTargetZ += TARGET_STEP_Z;
-                if (gNextTargetZ > TARGET_MAX_Z)
-                    gFoundAllTargets = true;
+                solution.status = TargetStatus::Unreachable;
+                continue;
             }
+
+            solution.rots = multiStartSeed(original, (int)(task % numRestarts) + 1);
+            while (!tickIK(solution))
+                ;
         }
+    };
 
-        tickIK(gTargets.back());
-    }
-    else if (!gWrittenResults)
+    vector<thread> workers;
+    for (int worker = 1; worker < numThreads; ++worker)
+        workers.emplace_back(workerMain);
+    workerMain();
+    for (auto& worker : workers)
+        worker.join();
+    double solveSecs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    // score everything against the original solutions, so replacing one cell doesn't move the others' goalposts
+    vector<BoneArray> references(targets.size(), REST_ROTATIONS);
+    if (objective == StartObjective::Smooth)
     {
-        cout << "\n\n\n-------------------------\n" << (4 * gTargets.size()) << "bytes needed for table" << endl;
-        writeResults();
-        gWrittenResults = true;
+        for (int cell = 0; cell < (int)targets.size(); ++cell)
+            references[cell] = neighbourMean(targets, shape, cell);
     }
-}
 
+    int numConverged = 0;
+    int numImproved = 0;
+    int numRescued = 0;
+    int64_t totalIterations = 0;
+    double totalBefore = 0.0;
+    double totalAfter = 0.0;
+    int numScored = 0;
+    vector<int> winningStarts(numStarts, 0);
+    for (size_t cell = 0; cell < targets.size(); ++cell)
+    {
+        TargetPoint& target = targets[cell];
+        float originalScore = startScore(target, objective, references[cell]);
+        float bestScore = originalScore;
+        int bestStart = 0;
+        for (int restart = 0; restart < numRestarts; ++restart)
+        {
+            const TargetPoint& solution = solutions[cell * numRestarts + restart];
+            numConverged += (solution.status == TargetStatus::Found) ? 1 : 0;
+            totalIterations += solution.iterations;
+
+            float score = startScore(solution, objective, references[cell]);
+            if (score < bestScore - minImprovement || (bestScore == numeric_limits<float>::max() && score < bestScore))
+            {
+                bestScore = score;
+                bestStart = restart + 1;
+            }
+        }
 
+        ++winningStarts[bestStart];
+        if (bestStart > 0)
+        {
+            ++numImproved;
+            numRescued += (target.status != TargetStatus::Found) ? 1 : 0;
+            target = solutions[cell * numRestarts + bestStart - 1];
+        }
+        if (originalScore != numeric_limits<float>::max())
+        {
+            totalBefore += originalScore;
+            totalAfter += bestScore;
+            ++numScored;
+        }
+    }
 
+    cout << "multi-start: " << numStarts << " starts/target, " << solutions.size() << " restarts in " << solveSecs << "s, "
+        << numConverged << " converged, " << (double)totalIterations / max<size_t>(1, solutions.size()) << " iterations/restart" << endl;
+    // cells that had no valid score before can't go in the mean, so say how many it's over
+    cout << "multi-start: restarts improved " << numImproved << " of " << targets.size() << " targets (" << numRescued
+        << " of them not found before), mean " << startObjectiveName(objective) << " over the " << numScored << " of "
+        << targets.size() << " scored before " << totalBefore / max(1, numScored) << " -> " << totalAfter / max(1, numScored) << endl;
+    if (gOptions.verbose)
+    {
+        cout << "multi-start: wins by start";
+        for (int start = 0; start < numStarts; ++start)
+            cout << " " << winningStarts[start];
+        cout << endl;
+    }
+}
 
 
-bool initGL()
+// how far the hand ends up from where we wanted it with these whole degree rotations
+float handErrorMm(const WholeBoneArray& rots, vec3 wanted)
 {
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_COLOR_MATERIAL);
-    glShadeModel(GL_FLAT);
+    BoneArray rotations;
+    for (int j = 0; j < NumBones; ++j)
+        rotations[j] = (float)rots[j];
+    return length(calcHandPoint(rotations) - wanted);
+}
 
-    glClearColor(0.9f, 0.45f, 0.2f, 1.0f);
+// samples the interpolated table every step mm over the grid and measures how far the hand ends up from where it was
+// asked to go, compared with just using the nearest grid point
+void measureInterpolationError(int step)
+{
+    TableCells cells = collectTableCells(false);
+    vector<float> interpErrors;
+    vector<float> nearestErrors;
+    for (int zMm = (int)TARGET_MIN_Z; zMm <= (int)TARGET_MAX_Z; zMm += step)
+    {
+        for (int xMm = (int)TARGET_MIN_X; xMm <= (int)TARGET_MAX_X; xMm += step)
+        {
+            vec3 wanted((float)xMm, TARGET_Y, (float)zMm);
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(60.0f, (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 2.f, 2000.0f);
+            WholeBoneArray rots;
+            interpolateTableMm(cells, xMm, zMm, rots);
+            interpErrors.push_back(handErrorMm(rots, wanted));
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+            // nearest cell, rounding halves up
+            int nearestX = ((int)floor((xMm + 5) / 10.f)) * 10;
+            int nearestZ = ((int)floor((zMm + 5) / 10.f)) * 10;
+            interpolateTableMm(cells, nearestX, nearestZ, rots);
+            nearestErrors.push_back(handErrorMm(rots, wanted));
+        }
+    }
 
-    float lightDir[] = { -0.7f, 0.3f, 0.5f, 0.f };
-    glLightfv(GL_LIGHT0, GL_POSITION, lightDir);
-    glEnable(GL_LIGHT0);
+    auto report = [](const char* name, vector<float>& errors)
+    {
+        sort(errors.begin(), errors.end());
+        double total = 0.0;
+        for (float error : errors)
+            total += error;
+        cout << name << ": mean " << total / errors.size() << "mm, 95th percentile " << errors[errors.size() * 95 / 100]
+            << "mm, max " << errors.back() << "mm" << endl;
+    };
+    cout << "hand position error over " << interpErrors.size() << " samples " << step << "mm apart:" << endl;
+    report("  nearest grid point", nearestErrors);
+    report("  lookupMm", interpErrors);
+}
 
-    gQuadric = gluNewQuadric();
-    if (!gQuadric)
+// run the whole solve as fast as we can without a window, for batch jobs on machines with no display
+int runHeadless()
+{
+    SolveCache cache;
+    if (!gOptions.cacheDir.empty())
     {
-        cerr << "couldn't allocate quadric" << endl;
-        return false;
+        if (!cache.open(gOptions.cacheDir))
+            return 1;
+        gSolveCache = &cache;
     }
 
-    float ambientLevel[] = { 0.3f, 0.3f, 0.3f, 1.f };
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambientLevel);
-  
-    return true;
-}
+    gTargets = makeTargetGrid();
+    int numThreads = gOptions.numThreads > 0 ? gOptions.numThreads : max(1, (int)thread::hardware_concurrency());
+    cout << "solving " << gTargets.size() << " targets headless on " << numThreads << " thread(s)..." << endl;
 
-bool init()
-{
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    auto startTime = chrono::high_resolution_clock::now();
+    if (gOptions.mirror)
+        solveTargetsMirrored(gTargets, targetGridShape(), numThreads, gOptions.order);
+    else
+        solveTargetsParallel(gTargets, targetGridShape(), numThreads, gOptions.order);
+    gFoundAllTargets = true;
+    auto solvedTime = chrono::high_resolution_clock::now();
+
+    if (gOptions.numStarts > 1)
+        solveTargetsMultiStart(gTargets, targetGridShape(), gOptions.numStarts, gOptions.startObjective, numThreads);
+    if (gOptions.exhaustive)
+        compareWithExhaustive(numThreads, gOptions.exhaustiveTable);
+    auto writeStartTime = chrono::high_resolution_clock::now();
+
+    // let update() write the results so we go through exactly the same path as the windowed build
+    update(0.f);
+    auto writtenTime = chrono::high_resolution_clock::now();
+
+    double solveSecs = chrono::duration<double>(solvedTime - startTime).count();
+    double writeSecs = chrono::duration<double>(writtenTime - writeStartTime).count();
+    cout << "solved " << gTargets.size() << " targets in " << solveSecs << "s ("
+        << (solveSecs > 0.0 ? gTargets.size() / solveSecs : 0.0) << " targets/sec)" << endl;
+    cout << "wrote results in " << writeSecs << "s, " << (solveSecs + writeSecs) << "s total" << endl;
+
+    int64_t totalIterations = 0;
+    int64_t totalFkEvaluations = 0;
+    int64_t totalRefineEvaluations = 0;
+    int64_t totalRefinePruned = 0;
+    int maxIterations = 0;
+    int numUnreachable = 0;
+    int numGaveUp = 0;
+    for (const auto& target : gTargets)
     {
-        cerr << "SDL could not initialize! SDL Error: " << SDL_GetError() << endl;
-        return false;
+        numUnreachable += (target.status == TargetStatus::Unreachable) ? 1 : 0;
+        numGaveUp += (target.status == TargetStatus::GaveUp) ? 1 : 0;
+        totalIterations += target.iterations;
+        totalFkEvaluations += target.fkEvaluations;
+        totalRefineEvaluations += target.refineEvaluations;
+        totalRefinePruned += target.refinePruned;
+        maxIterations = max(maxIterations, target.iterations);
     }
+    cout << "solver: " << (double)totalIterations / gTargets.size() << " iterations/target (max " << maxIterations << "), "
+        << (double)totalFkEvaluations / gTargets.size() << " fk evaluations/target" << endl;
+    if (numUnreachable > 0 || numGaveUp > 0)
+    {
+        cout << "WARNING: " << numUnreachable << " targets are out of reach and " << numGaveUp << " weren't found in "
+            << gOptions.maxIterations << " iterations, their table entries are just the pose we ended up in" << endl;
+    }
+    cout << "refinement: +-" << gOptions.refineWindow << " degrees, " << (double)totalRefineEvaluations / gTargets.size() << " poses evaluated/target, "
+        << (double)totalRefinePruned / gTargets.size() << " pruned/target" << endl;
 
-    int screenWidth = SCREEN_WIDTH;
-    int screenHeight = SCREEN_HEIGHT;
+    if (gOptions.interpErrorStep > 0)
+        measureInterpolationError(gOptions.interpErrorStep);
 
-    float defaultDpi = 96.f;
-    float dpi = defaultDpi;
-    if (SDL_GetDisplayDPI(0, nullptr, &dpi, nullptr))
+    if (gOptions.volume)
     {
-        cerr << "Failed to read screen dpi: " << SDL_GetError() << endl;
+        unique_ptr<TableWriter> writer;
+        if (gOptions.volumeBinary)
+            writer = make_unique<BinaryTableWriter>("robovolume.bin");
+        else
+            writer = make_unique<HeaderTableWriter>("robovolume.h");
+        if (!generateVolume(gOptions.volumeMinY, gOptions.volumeMaxY, gOptions.volumeStepY, *writer, numThreads))
+            return 1;
     }
-    float dpiRatio = dpi / defaultDpi;
-    screenWidth = (int)(dpiRatio * screenWidth);
-    screenHeight = (int)(dpiRatio * screenHeight);
 
-    //Create window
-    gWindow = SDL_CreateWindow("grippr",
-        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        screenWidth, screenHeight,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
-    if (!gWindow)
+    if (gSolveCache)
     {
-        cerr << "Window could not be created! SDL Error: " << SDL_GetError() << endl;
-        return false;
+        cout << "solve cache: " << cache.hits() << " hits, " << cache.misses() << " solved" << endl;
+        gSolveCache = nullptr;
     }
 
-    //Use OpenGL 2.1
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    return (gWrittenResults && !gWriteFailed) ? 0 : 1;
+}
 
-    //Create context
-    gContext = SDL_GL_CreateContext(gWindow);
-    if (gContext == NULL)
-    {
-        cerr << "OpenGL context could not be created! SDL Error: " << SDL_GetError() << endl;
+
+// matches "--name=value" style arguments
+bool matchOption(const string& arg, const string& name, string& value)
+{
+    if (!arg.starts_with(name) || arg.size() <= name.size() || arg[name.size()] != '=')
         return false;
+    value = arg.substr(name.size() + 1);
+    return true;
+}
+
+bool parseArgs(int argc, char* argv[])
+{
+    bool verbositySet = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        string value;
+        if (arg == "--headless")
+        {
+            gOptions.headless = true;
+        }
+        else if (arg == "--bench")
+        {
+            gOptions.bench = true;
+        }
+        else if (matchOption(arg, "--threads", value))
+        {
+            gOptions.numThreads = atoi(value.c_str());
+        }
+        else if (matchOption(arg, "--simd", value))
+        {
+            if (value == "auto")
+                gOptions.simd = SimdLevel::Auto;
+            else if (value == "scalar")
+                gOptions.simd = SimdLevel::Scalar;
+            else if (value == "avx2")
+                gOptions.simd = SimdLevel::Avx2;
+            else if (value == "avx512")
+                gOptions.simd = SimdLevel::Avx512;
+            else
+            {
+                cerr << "unknown simd level: " << value << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--refine-window", value))
+        {
+            gOptions.refineWindow = atoi(value.c_str());
+            if (gOptions.refineWindow < 1 || gOptions.refineWindow > MAX_REFINE_WINDOW)
+            {
+                cerr << "--refine-window must be between 1 and " << MAX_REFINE_WINDOW << endl;
+                return false;
+            }
+        }
+        else if (arg == "--mirror")
+        {
+            gOptions.mirror = true;
+        }
+        else if (arg == "--half-table")
+        {
+            gOptions.mirror = true;
+            gOptions.halfTable = true;
+        }
+        else if (matchOption(arg, "--encoding", value))
+        {
+            if (value == "raw")
+                gOptions.encoding = TableEncoding::Raw;
+            else if (value == "delta")
+                gOptions.encoding = TableEncoding::RowDelta;
+            else if (value == "bitpack")
+                gOptions.encoding = TableEncoding::BitPack;
+            else
+            {
+                cerr << "unknown table encoding: " << value << endl;
+                return false;
+            }
+        }
+        else if (arg == "--interp-error")
+        {
+            gOptions.interpErrorStep = 1;
+        }
+        else if (matchOption(arg, "--interp-error", value))
+        {
+            gOptions.interpErrorStep = atoi(value.c_str());
+            if (gOptions.interpErrorStep < 1)
+            {
+                cerr << "--interp-error step must be at least 1mm" << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--max-iterations", value))
+        {
+            gOptions.maxIterations = atoi(value.c_str());
+            if (gOptions.maxIterations < 1)
+            {
+                cerr << "--max-iterations must be at least 1" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--multi-start")
+        {
+            gOptions.numStarts = 8;
+        }
+        else if (matchOption(arg, "--multi-start", value))
+        {
+            gOptions.numStarts = atoi(value.c_str());
+            if (gOptions.numStarts < 1 || gOptions.numStarts > MAX_STARTS)
+            {
+                cerr << "--multi-start must be between 1 and " << MAX_STARTS << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--objective", value))
+        {
+            if (value == "error")
+                gOptions.startObjective = StartObjective::Error;
+            else if (value == "rest")
+                gOptions.startObjective = StartObjective::Rest;
+            else if (value == "smooth")
+                gOptions.startObjective = StartObjective::Smooth;
+            else
+            {
+                cerr << "unknown objective: " << value << endl;
+                return false;
+            }
+        }
+        else if (arg == "--legacy-render")
+        {
+            gOptions.legacyRender = true;
+        }
+        else if (arg == "--render-bench")
+        {
+            gOptions.renderBenchTargets = 10000;
+        }
+        else if (matchOption(arg, "--render-bench", value))
+        {
+            gOptions.renderBenchTargets = atoi(value.c_str());
+            if (gOptions.renderBenchTargets < 1)
+            {
+                cerr << "--render-bench needs at least 1 target" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--offscreen")
+        {
+            gOptions.offscreen = true;
+        }
+        else if (matchOption(arg, "--offscreen", value))
+        {
+            gOptions.offscreen = true;
+            gOptions.offscreenDir = value;
+        }
+        else if (matchOption(arg, "--steps-per-frame", value))
+        {
+            gOptions.offscreenStepsPerFrame = atoi(value.c_str());
+            if (gOptions.offscreenStepsPerFrame < 1)
+            {
+                cerr << "--steps-per-frame must be at least 1" << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--capture-every", value))
+        {
+            gOptions.offscreenCaptureEvery = atoi(value.c_str());
+            if (gOptions.offscreenCaptureEvery < 0)
+            {
+                cerr << "--capture-every can't be negative" << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--golden", value))
+        {
+            gOptions.goldenPath = value;
+        }
+        else if (matchOption(arg, "--golden-tolerance", value))
+        {
+            if (sscanf(value.c_str(), "%d,%f", &gOptions.goldenLevels, &gOptions.goldenPercent) != 2
+                || gOptions.goldenLevels < 0 || gOptions.goldenPercent < 0.f)
+            {
+                cerr << "--golden-tolerance wants LEVELS,PERCENT" << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--max-fps", value))
+        {
+            gOptions.maxFps = atoi(value.c_str());
+            if (gOptions.maxFps < 0)
+            {
+                cerr << "--max-fps can't be negative" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--vsync" || arg == "--no-vsync")
+        {
+            gOptions.vsync = (arg == "--vsync");
+        }
+        else if (arg == "--no-solver-thread")
+        {
+            gOptions.solverThread = false;
+        }
+        else if (matchOption(arg, "--frame-budget", value))
+        {
+            gOptions.frameBudgetMs = (float)atof(value.c_str());
+            if (gOptions.frameBudgetMs < 0.f)
+            {
+                cerr << "--frame-budget can't be negative" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--no-workspace-map")
+        {
+            gOptions.workspaceMap = false;
+        }
+        else if (arg == "--exhaustive")
+        {
+            gOptions.exhaustive = true;
+        }
+        else if (arg == "--exhaustive=table")
+        {
+            gOptions.exhaustive = true;
+            gOptions.exhaustiveTable = true;
+        }
+        else if (arg == "--cache")
+        {
+            gOptions.cacheDir = ".grippr-cache";
+        }
+        else if (matchOption(arg, "--cache", value))
+        {
+            gOptions.cacheDir = value;
+        }
+        else if (arg == "--binary")
+        {
+            gOptions.binaryTable = true;
+        }
+        else if (arg == "--volume" || arg == "--volume-binary")
+        {
+            gOptions.volume = true;
+            gOptions.volumeBinary = (arg == "--volume-binary");
+        }
+        else if (matchOption(arg, "--volume", value) || matchOption(arg, "--volume-binary", value))
+        {
+            gOptions.volume = true;
+            gOptions.volumeBinary = arg.starts_with("--volume-binary");
+            if (sscanf(value.c_str(), "%f,%f,%f", &gOptions.volumeMinY, &gOptions.volumeMaxY, &gOptions.volumeStepY) != 3
+                || gOptions.volumeStepY <= 0.f || gOptions.volumeMaxY < gOptions.volumeMinY)
+            {
+                cerr << "--volume wants MIN_Y,MAX_Y,STEP_Y in mm" << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--order", value))
+        {
+            if (value == "rowmajor")
+                gOptions.order = SolveOrder::RowMajor;
+            else if (value == "wavefront")
+                gOptions.order = SolveOrder::Wavefront;
+            else
+            {
+                cerr << "unknown solve order: " << value << endl;
+                return false;
+            }
+        }
+        else if (matchOption(arg, "--solver", value))
+        {
+            if (value == "gradient")
+                gOptions.solver = SolverType::Gradient;
+            else if (value == "analytic")
+                gOptions.solver = SolverType::Analytic;
+            else if (value == "dls")
+                gOptions.solver = SolverType::DampedLeastSquares;
+            else
+            {
+                cerr << "unknown solver: " << value << endl;
+                return false;
+            }
+        }
+        else if (arg == "--verbose" || arg == "--quiet")
+        {
+            gOptions.verbose = (arg == "--verbose");
+            verbositySet = true;
+        }
+        else
+        {
+            cerr << "unknown argument: " << arg << "\n";
+            cerr << "usage: grippr [--headless] [--bench] [--threads=N] [--solver=gradient|analytic|dls] [--simd=auto|scalar|avx2|avx512] [--refine-window=N] [--order=wavefront|rowmajor] [--mirror] [--half-table] [--encoding=raw|delta|bitpack] [--interp-error[=MM]] [--binary] [--cache[=DIR]] [--exhaustive[=table]] [--offscreen[=DIR]] [--steps-per-frame=N] [--capture-every=N] [--golden=PPM] [--golden-tolerance=LEVELS,PERCENT] [--legacy-render] [--render-bench[=N]] [--max-fps=N] [--vsync|--no-vsync] [--no-solver-thread] [--frame-budget=MS] [--max-iterations=N] [--no-workspace-map] [--multi-start[=N]] [--objective=error|rest|smooth] [--volume[-binary][=MIN_Y,MAX_Y,STEP_Y]] [--verbose|--quiet]" << endl;
+            return false;
+        }
     }
 
-    bool vsyncLock = false;
-    if (vsyncLock && SDL_GL_SetSwapInterval(1))
+    if (gOptions.mirror && !canMirrorTargetGrid())
     {
-        cerr << "Failed to get vsync: " << SDL_GetError() << endl;
+        cerr << "--mirror needs the target grid to be symmetric about x=0" << endl;
+        return false;
     }
 
-    return initGL();
+    // per-target logging costs more than the solve itself, so batch runs are quiet unless asked
+    if ((gOptions.headless || gOptions.bench || gOptions.offscreen) && !verbositySet)
+        gOptions.verbose = false;
+
+    return true;
 }
 
 
@@ -631,6 +5222,32 @@ void shutdown()
 
 int main(int argc, char* argv[])
 {
+    if (!parseArgs(argc, argv))
+        return 1;
+
+    SimdLevel simdLevel;
+    gFkKernels = selectFkKernels(gOptions.simd, &simdLevel);
+    if (gOptions.simd != SimdLevel::Auto && simdLevel != gOptions.simd)
+        cerr << simdLevelName(gOptions.simd) << " isn't supported on this cpu, using " << simdLevelName(simdLevel) << endl;
+
+    if (gOptions.bench)
+        return runBenchmarks();
+
+    if (gOptions.workspaceMap)
+    {
+        auto startTime = chrono::high_resolution_clock::now();
+        gWorkspaceMap.build();
+        gUseWorkspaceMap = true;
+        double buildSecs = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+        cout << "workspace map: " << gWorkspaceMap.numReachableCells() << " of " << gWorkspaceMap.numCells()
+            << " cells reachable, built in " << buildSecs << "s" << endl;
+    }
+
+    if (gOptions.headless)
+        return runHeadless();
+    if (gOptions.offscreen)
+        return runOffscreen();
+
     cout << "warming up sdl & opengl..." << endl;
     if (!init())
     {
@@ -638,22 +5255,64 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    if (gOptions.renderBenchTargets > 0)
+    {
+        int result = runRenderBench(gOptions.renderBenchTargets);
+        shutdown();
+        return result;
+    }
+
+    // laid out up front, so nothing ever moves under render()
+    gTargets = makeTargetGrid();
+    thread solver;
+    if (gOptions.solverThread)
+        solver = thread(solverThreadMain);
+
+    // only draw when there's something new to show: a snapshot from the solver, the in-frame solve still going, or
+    // input (which includes the window being exposed or resized). otherwise sleep in SDL_WaitEventTimeout, waking now
+    // and then to see if the solver thread has published anything
+    static const int idleWaitMs = 100;
+    auto frameInterval = chrono::duration_cast<chrono::high_resolution_clock::duration>(
+        chrono::duration<double>(gOptions.maxFps > 0 ? 1.0 / gOptions.maxFps : 0.0));
+
     bool quit = false;
+    bool needsRedraw = true;
     auto startTime = chrono::high_resolution_clock::now();
     auto lastFrameTime = startTime;
+    auto nextFrameTime = startTime;
     float deltaTime = 0.f;
     while (!quit)
     {
+        bool solvingInFrame = !gOptions.solverThread && !gWrittenResults;
+        bool dirty = needsRedraw || solvingInFrame || gViewSnapshots.hasFresh();
+
+        int waitMs = idleWaitMs;
+        if (dirty)
+        {
+            auto untilFrame = nextFrameTime - chrono::high_resolution_clock::now();
+            waitMs = max(0, (int)chrono::ceil<chrono::milliseconds>(untilFrame).count());
+        }
+
         // process input
         SDL_Event e;
-        while (SDL_PollEvent(&e) != 0)
+        if (SDL_WaitEventTimeout(&e, waitMs) != 0)
         {
-            if (e.type == SDL_QUIT)
-                quit = true;
-            else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
-                quit = true;
+            do
+            {
+                if (e.type == SDL_QUIT)
+                    quit = true;
+                else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
+                    quit = true;
+                needsRedraw = true;
+            } while (SDL_PollEvent(&e) != 0);
         }
 
+        auto frameStart = chrono::high_resolution_clock::now();
+        if (quit || !(needsRedraw || solvingInFrame || gViewSnapshots.hasFresh()) || frameStart < nextFrameTime)
+            continue;
+        nextFrameTime = max(nextFrameTime + frameInterval, frameStart);
+        needsRedraw = false;
+
         // update time
         {
             auto now = chrono::high_resolution_clock::now();
@@ -665,15 +5324,23 @@ int main(int argc, char* argv[])
             gWallTime = ((double)uwallTime) / 1'000'000.0;
         }
 
-        update(deltaTime);
-        render();
+        if (solvingInFrame)
+            update(deltaTime);
+        // one snapshot for the whole frame, so the title can't take a newer one the picture hasn't shown yet
+        const ViewSnapshot& view = gViewSnapshots.read();
+        render(view);
+        updateWindowTitle(view);
 
         SDL_GL_SwapWindow(gWindow);
     }
 
+    gStopSolver = true;
+    if (solver.joinable())
+        solver.join();
+
     shutdown();
 
-    return 0;
+    return gWriteFailed ? 1 : 0;
 }
 
 
@@ -0,0 +1,215 @@
+#pragma once
+
+// the binary rotation tables grippr writes with --binary, and a tiny reader that maps them straight into memory so
+// host tools can look cells up without parsing anything
+//
+// a table file is a RoboTableHeader followed, at payloadOffset, by the cells: for each Y level, for each row of z,
+// for each x, 4 signed bytes [BASE_ROT, SHOULDER, ELBOW, WRIST]. everything is little-endian
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static const char ROBOTABLE_MAGIC[4] = { 'R', 'B', 'T', 'B' };
+static const uint16_t ROBOTABLE_VERSION = 1;
+static const uint32_t ROBOTABLE_PAYLOAD_ALIGNMENT = 64;
+static const uint8_t ROBOTABLE_ENCODING_RAW = 0;
+
+struct RoboTableHeader
+{
+    char magic[4];              // ROBOTABLE_MAGIC
+    uint16_t version;           // ROBOTABLE_VERSION
+    uint16_t headerSize;        // sizeof(RoboTableHeader), so later versions can grow it
+    int16_t minX;               // grid bounds, in cm like roboboogie.h
+    int16_t minZ;
+    uint16_t countX;
+    uint16_t countZ;
+    uint16_t countY;            // number of Y levels
+    uint16_t stepXZ;            // grid spacing, in mm
+    int16_t minY;               // height of the lowest level, in mm
+    int16_t stepY;              // and the spacing between levels
+    uint8_t encoding;           // ROBOTABLE_ENCODING_RAW is the only one so far
+    uint8_t cellBytes;          // 4
+    uint16_t reserved0;
+    uint32_t payloadOffset;     // from the start of the file, a multiple of ROBOTABLE_PAYLOAD_ALIGNMENT
+    uint32_t payloadBytes;
+    uint32_t checksum;          // robotableChecksum() of the payload
+    uint32_t reserved1;
+    uint32_t reserved2;
+};
+static_assert(sizeof(RoboTableHeader) == 48, "RoboTableHeader is written straight to disk, so its layout can't change");
+
+// FNV-1a, fed a chunk at a time so the payload can be checksummed as it's streamed out
+inline uint32_t robotableChecksum(const void* data, size_t size, uint32_t hash = 2166136261u)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+
+// maps a table file read-only. open() only checks the header, so it costs the same however big the table is
+class RoboTable
+{
+public:
+    RoboTable() = default;
+    RoboTable(const RoboTable&) = delete;
+    RoboTable& operator=(const RoboTable&) = delete;
+
+    ~RoboTable()
+    {
+        close();
+    }
+
+    // returns false and sets error if the file can't be mapped or isn't a table we understand
+    bool open(const char* path, const char** error = nullptr)
+    {
+        close();
+
+        const char* failure = map(path);
+        if (!failure)
+            failure = validate();
+        if (failure)
+        {
+            close();
+            if (error)
+                *error = failure;
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (mData)
+            UnmapViewOfFile(mData);
+        if (mMapping)
+            CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE)
+            CloseHandle(mFile);
+        mMapping = nullptr;
+        mFile = INVALID_HANDLE_VALUE;
+#else
+        if (mData)
+            munmap((void*)mData, mSize);
+#endif
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    bool isOpen() const
+    {
+        return mData != nullptr;
+    }
+
+    const RoboTableHeader& header() const
+    {
+        return *(const RoboTableHeader*)mData;
+    }
+
+    // the 4 rotations at grid point (x,z), in cm, on level yLevel, or nullptr if that's outside the table
+    const int8_t* cell(int x, int z, int yLevel = 0) const
+    {
+        const RoboTableHeader& h = header();
+        unsigned ix = (unsigned)(x - h.minX);
+        unsigned iz = (unsigned)(z - h.minZ);
+        if (ix >= h.countX || iz >= h.countZ || (unsigned)yLevel >= h.countY)
+            return nullptr;
+        return mCells + (((size_t)yLevel * h.countZ + iz) * h.countX + ix) * h.cellBytes;
+    }
+
+    // reads the whole payload, so only worth doing once, e.g. after copying tables around
+    bool verifyChecksum() const
+    {
+        return robotableChecksum(mCells, header().payloadBytes) == header().checksum;
+    }
+
+private:
+    const char* map(const char* path)
+    {
+#if defined(_WIN32)
+        mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mFile == INVALID_HANDLE_VALUE)
+            return "couldn't open the file";
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mFile, &size))
+            return "couldn't get the file size";
+        mSize = (size_t)size.QuadPart;
+        if (mSize < sizeof(RoboTableHeader))
+            return "file is too small to be a table";
+
+        mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mMapping)
+            return "couldn't map the file";
+        mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return "couldn't open the file";
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return "couldn't get the file size";
+        }
+        mSize = (size_t)st.st_size;
+        if (mSize < sizeof(RoboTableHeader))
+        {
+            ::close(fd);
+            return "file is too small to be a table";
+        }
+
+        // the mapping keeps its own reference to the file
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        mData = (data != MAP_FAILED) ? (const uint8_t*)data : nullptr;
+#endif
+        return mData ? nullptr : "couldn't map the file";
+    }
+
+    const char* validate()
+    {
+        const RoboTableHeader& h = header();
+        if (memcmp(h.magic, ROBOTABLE_MAGIC, sizeof(h.magic)) != 0)
+            return "not a robot table";
+        if (h.version != ROBOTABLE_VERSION || h.headerSize != sizeof(RoboTableHeader))
+            return "unsupported table version";
+        if (h.encoding != ROBOTABLE_ENCODING_RAW || h.cellBytes != 4)
+            return "unsupported table encoding";
+        if (h.payloadOffset % ROBOTABLE_PAYLOAD_ALIGNMENT != 0
+            || (size_t)h.countX * h.countZ * h.countY * h.cellBytes != h.payloadBytes
+            || (size_t)h.payloadOffset + h.payloadBytes > mSize)
+            return "table header doesn't match the file";
+
+        mCells = (const int8_t*)(mData + h.payloadOffset);
+        return nullptr;
+    }
+
+    const uint8_t* mData = nullptr;
+    const int8_t* mCells = nullptr;
+    size_t mSize = 0;
+#if defined(_WIN32)
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+#endif
+};